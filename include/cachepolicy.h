@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 缓存项的侵入式节点，由缓存的使用者嵌入到自己的缓存项中，替换策略只通过指针操作节点
+struct CacheNode
+{
+    CacheNode *prev = nullptr;
+    CacheNode *next = nullptr;
+    // key的哈希值，用于频率统计
+    uint64_t hash = 0;
+    // 节点所在的队列，含义由各个策略决定
+    uint8_t queue = 0;
+    // 访问计数，含义由各个策略决定
+    uint8_t freq = 0;
+};
+
+// 带哨兵的双向循环链表，头部为最新的节点
+class CacheNodeList
+{
+public:
+    CacheNodeList();
+    CacheNodeList(const CacheNodeList &) = delete;
+    CacheNodeList &operator=(const CacheNodeList &) = delete;
+
+    void pushFront(CacheNode *node);
+    void remove(CacheNode *node);
+    // 链表头部（最新）的节点，链表为空时返回nullptr
+    CacheNode *front() const;
+    // 链表尾部（最旧）的节点，链表为空时返回nullptr
+    CacheNode *back() const;
+    size_t size() const;
+
+private:
+    CacheNode m_head;
+    size_t m_size = 0;
+};
+
+// 4行的Count-Min Sketch，每个计数器最大为15，计数总数达到阈值时全部减半，使频率随时间衰减
+class FrequencySketch
+{
+public:
+    // capacity为预计的缓存项数量
+    explicit FrequencySketch(size_t capacity);
+    void increment(uint64_t hash);
+    // 估计hash的访问频率
+    int frequency(uint64_t hash) const;
+
+private:
+    static constexpr int DEPTH = 4;
+    std::vector<uint8_t> m_table;
+    size_t m_mask;
+    size_t m_additions = 0;
+    size_t m_sampleSize;
+
+    size_t index(uint64_t hash, int row) const;
+    void reset();
+};
+
+// 缓存替换策略的接口
+// 缓存在每次访问时通知策略，并在超出容量时向策略询问淘汰哪一个节点
+class CachePolicy
+{
+public:
+    virtual ~CachePolicy() = default;
+    // 访问了一个已经缓存的节点
+    virtual void onHit(CacheNode *node) = 0;
+    // 访问了一个没有被缓存的key
+    virtual void onMiss(uint64_t /*hash*/) {}
+    // 新的节点加入了缓存
+    virtual void onInsert(CacheNode *node) = 0;
+    // 节点被移出了缓存（被淘汰或者已经过期）
+    virtual void onRemove(CacheNode *node) = 0;
+    // 选择下一个要淘汰的节点，可能是刚刚插入的节点（即拒绝接纳），缓存为空时返回nullptr
+    virtual CacheNode *victim() = 0;
+
+    // 根据名称创建策略，可选lru、tinylfu和s3fifo，名称无效时返回nullptr
+    // capacity为预计的缓存项数量
+    static std::unique_ptr<CachePolicy> create(const std::string &name, size_t capacity);
+};
+
+// 最近最少使用
+class LRUPolicy : public CachePolicy
+{
+public:
+    void onHit(CacheNode *node) override;
+    void onInsert(CacheNode *node) override;
+    void onRemove(CacheNode *node) override;
+    CacheNode *victim() override;
+
+private:
+    CacheNodeList m_list;
+};
+
+// W-TinyLFU：新节点先进入占总数1%的LRU窗口，被挤出窗口的节点作为候选者进入主缓存，淘汰时与主缓存中最旧的节点比较访问频率，频率更高的留下
+// 主缓存为分段LRU，在观察段中再次被访问的节点进入占主缓存80%的保护段，一次性的扫描无法挤掉热点数据
+class TinyLFUPolicy : public CachePolicy
+{
+public:
+    explicit TinyLFUPolicy(size_t capacity);
+    void onHit(CacheNode *node) override;
+    void onMiss(uint64_t hash) override;
+    void onInsert(CacheNode *node) override;
+    void onRemove(CacheNode *node) override;
+    CacheNode *victim() override;
+
+private:
+    enum Queue : uint8_t
+    {
+        WINDOW,
+        PROBATION,
+        PROTECTED
+    };
+
+    FrequencySketch m_sketch;
+    CacheNodeList m_window;
+    CacheNodeList m_probation;
+    CacheNodeList m_protected;
+
+    CacheNodeList &list(uint8_t queue);
+};
+
+// S3-FIFO：新节点进入占总数10%的小FIFO队列，在其中被再次访问过的节点进入主FIFO队列，否则被淘汰并记入幽灵队列
+// 幽灵队列中的key再次被插入时直接进入主队列；主队列中被访问过的节点会被重新放回队首
+class S3FIFOPolicy : public CachePolicy
+{
+public:
+    void onHit(CacheNode *node) override;
+    void onInsert(CacheNode *node) override;
+    void onRemove(CacheNode *node) override;
+    CacheNode *victim() override;
+
+private:
+    enum Queue : uint8_t
+    {
+        SMALL,
+        MAIN
+    };
+    static constexpr uint8_t MAX_FREQ = 3;
+
+    CacheNodeList m_small;
+    CacheNodeList m_main;
+    // 最近从小队列中淘汰的key的哈希值和进入幽灵队列时的代数，幽灵的数量不超过主队列
+    // 同一个key再次进入幽灵队列时只更新代数，队列中代数不一致的旧记录已经失效，出队时直接丢弃
+    std::deque<std::pair<uint64_t, uint64_t>> m_ghostOrder;
+    std::unordered_map<uint64_t, uint64_t> m_ghost;
+    uint64_t m_ghostGeneration = 0;
+
+    void addGhost(uint64_t hash);
+};
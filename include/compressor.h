@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+
+#include "httpheaderparser.h"
+
+// 内容编码的压缩实现，gzip依赖zlib（HAVE_ZLIB），zstd依赖libzstd（HAVE_ZSTD），构建时没有找到的库对应的编码不可用
+namespace Compressor
+{
+    // 当前构建是否支持该编码
+    bool isSupported(HTTPHeaderParser::Encoding encoding);
+    // 以较高的压缩级别压缩size字节的数据，结果只生成一次之后被缓存，所以压缩速度不是首要的考虑；不支持该编码或者压缩失败时返回std::nullopt
+    std::optional<std::string> compress(HTTPHeaderParser::Encoding encoding, const void *data, size_t size);
+}
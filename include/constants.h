@@ -1,6 +1,8 @@
 #pragma once
 
-#include <unordered_map>
+#include <cstddef>
+#include <string_view>
+#include <utility>
 
 const int READ_BUFFER_SIZE = 2048;
 const int WRITE_BUFFER_SIZE = 1024;
@@ -9,14 +11,15 @@ const int LISTEN_PORT = 12345;
 const int BACKLOG_SIZE = 5;
 const int MAX_EVENT_SIZE = 65535;
 const int MAX_FD_SIZE = 65535;
+// 过载时重试被推迟的任务和连接的间隔
+const int OVERLOAD_RETRY_INTERVAL_MS = 1;
+// 使用sendfile发送文件时，每次处理写入事件最多发送的字节数，发送完一个窗口之后让出工作线程
+const size_t SENDFILE_WINDOW_SIZE = 4 * 1024 * 1024;
+// 一次sendmsg最多合并的内存片段数量，流水线中的多个响应通常可以在一次调用中发送
+const int WRITE_IOV_SIZE = 256;
 
-const std::unordered_map<std::string, std::string> mimeLookUpTable = {
-    {".*3gpp", "audio/3gpp"},
-    {".*jpm", "video/jpm"},
-    {".*mp3", "audio/mp3"},
-    {".*rtf", "text/rtf"},
-    {".*wav", "audio/wave"},
-    {".*xml", "text/xml"},
+// 内置的MIME类型，键为小写的后缀名（包括开头的点），由MimeTypes在编译期生成完美哈希表
+constexpr std::pair<std::string_view, std::string_view> mimeLookUpTable[] = {
     {".3g2", "video/3gpp2"},
     {".3gp", "video/3gpp"},
     {".3gpp", "video/3gpp"},
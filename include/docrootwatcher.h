@@ -0,0 +1,55 @@
+#pragma once
+
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "filecachepool.h"
+
+// 使用inotify监视根目录树，文件被修改、移动或删除时使文件缓存池中对应的缓存项失效
+// 监视生效时缓存命中不需要访问文件系统；监视数量达到上限或者事件队列溢出时无法保证缓存的正确性，
+// 此时调用fallback回调，由调用者回退到定期验证
+class DocRootWatcher
+{
+public:
+    DocRootWatcher(std::shared_ptr<FileCachePool> pool, const std::filesystem::path &root);
+    ~DocRootWatcher();
+    // 为根目录树添加监视并启动后台线程，失败时返回false，reason为失败的原因
+    bool start(std::string &reason);
+    void stop();
+    // 启动之后不再能保证缓存正确时调用，只会调用一次，在后台线程中执行
+    void setFallback(std::function<void(const std::string &reason)> fallback);
+    // 监视是否仍然有效
+    bool isWatching() const;
+
+private:
+    static constexpr uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+    std::shared_ptr<FileCachePool> m_pool;
+    std::filesystem::path m_root;
+    int m_inotifyfd = -1;
+    // 用于停止后台线程
+    int m_wakefd = -1;
+    // 监视描述符到目录路径的映射
+    std::unordered_map<int, std::string> m_dirs;
+    std::thread m_thread;
+    std::atomic<bool> m_watching = false;
+    std::function<void(const std::string &reason)> m_fallback;
+
+    // 监视目录及其全部子目录，监视数量达到上限时返回false
+    bool addWatchRecursive(const std::filesystem::path &dir, std::string &reason);
+    void loop();
+    void handleEvent(const inotify_event *event);
+    void fallback(const std::string &reason);
+};
@@ -6,23 +6,92 @@
 #include <sys/uio.h>
 #include <fcntl.h>
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <future>
 #include <memory>
+#include <optional>
 #include <string>
+#include <thread>
 #include <unordered_map>
-#include <list>
+#include <unordered_set>
+#include <vector>
 #include <mutex>
 
+#include "cachepolicy.h"
+#include "httpheaderparser.h"
+#include "mimetypes.h"
+#include "slabarena.h"
+
 class FileCacheItem
 {
 public:
-    FileCacheItem(const std::string &path) : m_path(path), m_data(nullptr)
+    /**
+     * @brief Load a file into memory
+     * 
+     * @param path file path
+     * @param arena files no larger than arena->maxBlock() are read into the arena, larger files are mmapped; nullptr mmaps every file
+     * @param sendfile_min files of at least this size are kept as an open fd for sendfile() instead of being mapped, 0 never keeps an fd
+     * @param stream_min files of at least this size are streamed: kept as an fd opened for sequential reading and never cached, 0 never streams
+     * @param hash_etag derive the ETag from a hash of the content for files in memory, so that copies with different mtimes share it
+     */
+    FileCacheItem(const std::string &path, std::shared_ptr<SlabArena> arena = nullptr, off_t sendfile_min = 0, off_t stream_min = 0, bool hash_etag = false)
+        : m_path(path), m_data(nullptr), m_arena(arena), m_sendfileMin(sendfile_min), m_streamMin(stream_min)
     {
         loadFile();
+        if (isLoaded())
+        {
+            makeValidators(hash_etag);
+        }
+    }
+
+    /**
+     * @brief Wrap a compressed copy of a loaded item, stored in the arena when it fits
+     * 
+     * The copy keeps the path and modification time of the source, its ETag is the source ETag tagged with the
+     * encoding. An empty data makes a placeholder that is not loaded, recording that compression did not pay off.
+     * 
+     * @param source the identity item
+     * @param encoding content encoding of data
+     * @param data compressed body
+     * @param arena storage of small bodies
+     */
+    FileCacheItem(const FileCacheItem &source, HTTPHeaderParser::Encoding encoding, std::string data, std::shared_ptr<SlabArena> arena = nullptr)
+        : m_path(source.m_path), m_data(nullptr), m_fstat(source.m_fstat), m_arena(arena), m_sendfileMin(0), m_streamMin(0),
+          m_lastModified(source.m_lastModified), m_sourceETag(source.m_etag)
+    {
+        m_fstat.st_size = data.size();
+        m_etag = m_sourceETag;
+        m_etag.insert(m_etag.empty() ? 0 : m_etag.size() - 1, std::string("-") + HTTPHeaderParser::encoding2str(encoding));
+        if (data.empty())
+            return;
+        if (m_arena && data.size() <= m_arena->maxBlock() && (m_data = m_arena->allocate(data.size())) != nullptr)
+        {
+            memcpy(m_data, data.data(), data.size());
+            m_inArena = true;
+            return;
+        }
+        m_buffer = std::move(data);
+        m_data = m_buffer.data();
     }
 
     ~FileCacheItem()
     {
-        if (m_data != nullptr)
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+        }
+        if (m_data == nullptr)
+            return;
+        if (m_inArena)
+        {
+            m_arena->deallocate(m_data, m_fstat.st_size);
+        }
+        else if (m_buffer.empty())
         {
             munmap(m_data, m_fstat.st_size);
         }
@@ -33,16 +102,247 @@ public:
         return m_path;
     }
 
+    /**
+     * @brief File content in memory
+     * 
+     * @return const void* the content, or nullptr if the file is served from getFd()
+     */
     const void *getData() const
     {
         return m_data;
     }
 
+    /**
+     * @brief Open fd of a large file, to be sent with sendfile()
+     * 
+     * @return int the fd, or -1 if the content is in memory
+     */
+    int getFd() const
+    {
+        return m_fd;
+    }
+
+    /**
+     * @brief Whether the file was loaded and can be served
+     * 
+     */
+    bool isLoaded() const
+    {
+        return m_data != nullptr || m_fd >= 0;
+    }
+
+    /**
+     * @brief Whether the body and every precompressed sibling are held in user memory (arena or buffer),
+     * so sending them never reads from disk; mmapped bodies may still fault their pages in
+     * 
+     */
+    bool isInMemory() const
+    {
+        for (auto &variant : m_variants)
+        {
+            if (variant && !variant->isInMemory())
+                return false;
+        }
+        return m_fd < 0 && (m_inArena || !m_buffer.empty() || m_fstat.st_size == 0);
+    }
+
+    /**
+     * @brief Strong validator of the file, computed once when it is loaded
+     * 
+     * @return const std::string& quoted entity tag
+     */
+    const std::string &getETag() const
+    {
+        return m_etag;
+    }
+
+    /**
+     * @brief mtime of the file formatted as an HTTP date, computed once when it is loaded
+     * 
+     */
+    const std::string &getLastModified() const
+    {
+        return m_lastModified;
+    }
+
+    /**
+     * @brief Render the fixed part of a full 200 response once, only before the item is shared
+     * 
+     * The block holds the status line and every header that depends only on the item, so a plain GET
+     * sends it as is and appends just Date, Connection and the blank line.
+     * 
+     * @param content_type MIME type of the identity file
+     * @param encoding Content-Encoding of the body, nullptr for identity
+     * @param vary whether responses for the file depend on Accept-Encoding
+     */
+    void setResponseHeaders(std::string_view content_type, const char *encoding, bool vary)
+    {
+        m_contentType = content_type;
+        m_encoding = encoding;
+        m_vary = vary;
+        m_headerBlock = "HTTP/1.1 200 OK\r\nAccept-Ranges: bytes\r\nContent-Length: ";
+        m_headerBlock += std::to_string(m_fstat.st_size);
+        m_headerBlock += "\r\nContent-Type: ";
+        m_headerBlock += m_contentType;
+        if (m_encoding)
+        {
+            m_headerBlock += "\r\nContent-Encoding: ";
+            m_headerBlock += m_encoding;
+        }
+        m_headerBlock += "\r\nETag: ";
+        m_headerBlock += m_etag;
+        m_headerBlock += "\r\nLast-Modified: ";
+        m_headerBlock += m_lastModified;
+        if (m_vary)
+        {
+            m_headerBlock += "\r\nVary: Accept-Encoding";
+        }
+        m_headerBlock += "\r\n";
+    }
+
+    /**
+     * @brief Status line and fixed headers of a full 200 response, without the blank line
+     * 
+     */
+    const std::string &getHeaderBlock() const
+    {
+        return m_headerBlock;
+    }
+
+    const std::string &getContentType() const
+    {
+        return m_contentType;
+    }
+
+    /**
+     * @brief Content-Encoding of the body, nullptr for identity
+     * 
+     */
+    const char *getEncoding() const
+    {
+        return m_encoding;
+    }
+
+    /**
+     * @brief Whether responses for the file depend on Accept-Encoding
+     * 
+     */
+    bool getVary() const
+    {
+        return m_vary;
+    }
+
+    /**
+     * @brief ETag of the item a compressed copy was made from, empty for items loaded from files
+     * 
+     */
+    const std::string &getSourceETag() const
+    {
+        return m_sourceETag;
+    }
+
+    /**
+     * @brief Whether the file is too large to be cached and is streamed from getFd() instead
+     * 
+     */
+    bool isStreaming() const
+    {
+        return m_streaming;
+    }
+
     const struct stat *getStat() const
     {
         return &m_fstat;
     }
 
+    /**
+     * @brief Memory actually held by the item: the arena block size, st_size rounded up to whole pages for mmapped files,
+     * or nothing for files served from an fd, whose pages belong to the kernel page cache
+     * 
+     * @return off_t resident bytes
+     */
+    off_t getResidentSize() const
+    {
+        off_t resident = 0;
+        for (auto &variant : m_variants)
+        {
+            if (variant)
+                resident += variant->getResidentSize();
+        }
+        if (m_fd >= 0)
+            return resident;
+        if (m_inArena)
+            return resident + m_arena->blockSize(m_fstat.st_size);
+        static const off_t page = sysconf(_SC_PAGESIZE);
+        return resident + (m_fstat.st_size + page - 1) / page * page;
+    }
+
+    /**
+     * @brief Attach a precompressed sibling (e.g. index.html.gz), only before the item is shared
+     * 
+     * @param encoding content encoding of the sibling
+     * @param variant loaded sibling, its resident size is counted as part of this item
+     */
+    void setVariant(HTTPHeaderParser::Encoding encoding, std::shared_ptr<FileCacheItem> variant)
+    {
+        m_variants[static_cast<size_t>(encoding)] = variant;
+    }
+
+    /**
+     * @brief Precompressed sibling in the given encoding
+     * 
+     * @return std::shared_ptr<FileCacheItem> the sibling, or nullptr if there is none
+     */
+    std::shared_ptr<FileCacheItem> getVariant(HTTPHeaderParser::Encoding encoding) const
+    {
+        return m_variants[static_cast<size_t>(encoding)];
+    }
+
+    /**
+     * @brief Whether any precompressed sibling exists, responses then vary on Accept-Encoding
+     * 
+     */
+    bool hasVariants() const
+    {
+        for (auto &variant : m_variants)
+        {
+            if (variant)
+                return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Record what the load saw at a precompressed sibling's path, only before the item is shared
+     * 
+     * @param encoding content encoding of the sibling
+     * @param fstat stat of the sibling, nullptr if it did not exist
+     */
+    void setSiblingStat(HTTPHeaderParser::Encoding encoding, const struct stat *fstat)
+    {
+        m_siblingsProbed = true;
+        m_siblingStats[static_cast<size_t>(encoding)] = fstat ? std::optional<struct stat>(*fstat) : std::nullopt;
+    }
+
+    /**
+     * @brief Whether the precompressed siblings were looked for when the item was loaded
+     * 
+     */
+    bool siblingsProbed() const
+    {
+        return m_siblingsProbed;
+    }
+
+    /**
+     * @brief Stat of a precompressed sibling when the item was loaded
+     * 
+     * @return std::optional<struct stat> the stat, or nullopt if the sibling did not exist
+     */
+    const std::optional<struct stat> &getSiblingStat(HTTPHeaderParser::Encoding encoding) const
+    {
+        return m_siblingStats[static_cast<size_t>(encoding)];
+    }
+
 private:
     void loadFile()
     {
@@ -50,9 +350,29 @@ private:
             return;
         if (!(m_fstat.st_mode & S_IROTH) || S_ISDIR(m_fstat.st_mode))
             return;
-        int fd = open(m_path.c_str(), O_RDONLY);
+        int fd = open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
         if (fd < 0)
             return;
+        if (m_streamMin > 0 && m_fstat.st_size >= m_streamMin)
+        {
+            // 从头到尾读取一次：让内核积极地预读
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            m_fd = fd;
+            m_streaming = true;
+            return;
+        }
+        if (m_sendfileMin > 0 && m_fstat.st_size >= m_sendfileMin)
+        {
+            // 保留fd，文件内容由内核复制到socket，不经过用户态内存
+            m_fd = fd;
+            return;
+        }
+        if (m_arena && m_fstat.st_size > 0 && static_cast<size_t>(m_fstat.st_size) <= m_arena->maxBlock())
+        {
+            readToArena(fd);
+            ::close(fd);
+            return;
+        }
         m_data = ::mmap(0, m_fstat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
         ::close(fd);
         if (m_data == MAP_FAILED)
@@ -62,9 +382,72 @@ private:
         }
     }
 
+    void makeValidators(bool hash_etag)
+    {
+        m_lastModified = HTTPHeaderParser::formatDate(m_fstat.st_mtim.tv_sec);
+        if (!hash_etag || m_data == nullptr)
+        {
+            // 不包含inode，使同一个文件的多个副本得到相同的ETag
+            m_etag = HTTPHeaderParser::makeETag(m_fstat);
+            return;
+        }
+        // FNV-1a，每次加载时在分片的锁外计算一次
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        auto data = static_cast<const unsigned char *>(m_data);
+        for (off_t i = 0; i < m_fstat.st_size; i++)
+        {
+            hash = (hash ^ data[i]) * 0x100000001b3ULL;
+        }
+        char buf[64];
+        snprintf(buf, sizeof(buf), "\"%016llx-%lx\"", static_cast<unsigned long long>(hash), static_cast<unsigned long>(m_fstat.st_size));
+        m_etag = buf;
+    }
+
+    void readToArena(int fd)
+    {
+        void *data = m_arena->allocate(m_fstat.st_size);
+        if (data == nullptr)
+            return;
+        off_t offset = 0;
+        while (offset < m_fstat.st_size)
+        {
+            ssize_t len = ::pread(fd, static_cast<char *>(data) + offset, m_fstat.st_size - offset, offset);
+            if (len < 0 && errno == EINTR)
+                continue;
+            if (len <= 0)
+            {
+                // stat之后文件变小了
+                m_arena->deallocate(data, m_fstat.st_size);
+                return;
+            }
+            offset += len;
+        }
+        m_data = data;
+        m_inArena = true;
+    }
+
     std::string m_path;
     void *m_data;
     struct stat m_fstat;
+    std::shared_ptr<SlabArena> m_arena;
+    bool m_inArena = false;
+    off_t m_sendfileMin;
+    off_t m_streamMin;
+    int m_fd = -1;
+    bool m_streaming = false;
+    std::string m_etag;
+    std::string m_lastModified;
+    std::array<std::shared_ptr<FileCacheItem>, HTTPHeaderParser::ENCODING_COUNT> m_variants;
+    // 加载时每个预压缩文件的stat，包括被拒绝的旧文件，不存在的为空
+    std::array<std::optional<struct stat>, HTTPHeaderParser::ENCODING_COUNT> m_siblingStats;
+    bool m_siblingsProbed = false;
+    // 放不进arena的压缩副本的内容
+    std::string m_buffer;
+    std::string m_sourceETag;
+    std::string m_contentType;
+    const char *m_encoding = nullptr;
+    bool m_vary = false;
+    std::string m_headerBlock;
 };
 
 class FileCachePool
@@ -73,25 +456,302 @@ public:
     /**
      * @brief Construct a new File Cache Pool object
      * 
-     * @param max_size max total file size in bytes 
+     * @param max_size max total resident bytes of the cached files
      * @param max_item max total file item count
+     * @param shards number of independently locked shards, paths are assigned by hash
+     * @param policy replacement policy of each shard: lru, tinylfu or s3fifo, unknown names fall back to lru
+     * @param small_file files up to this size are packed into a shared slab arena instead of being mmapped one by one, 0 mmaps every file
+     * @param sendfile_min files of at least this size are cached as an open fd and sent with sendfile(), 0 never uses sendfile
+     * @param stream_min files of at least this size, or larger than max_size, bypass the cache and are streamed from an fd, 0 streams only files larger than max_size
      */
-    FileCachePool(off_t max_size, int max_item);
+    FileCachePool(off_t max_size, int max_item, int shards = 1, const std::string &policy = "lru", size_t small_file = 16384, off_t sendfile_min = 1048576, off_t stream_min = 0);
     ~FileCachePool();
 
     std::shared_ptr<FileCacheItem> getFile(const std::string &path);
+    /**
+     * @brief Get a file only if it is already cached and fresh, never touches the disk (no stat, no load)
+     * 
+     * @param path file path
+     * @return std::shared_ptr<FileCacheItem> cached file, or nullptr if the file is not cached or due for revalidation
+     */
+    std::shared_ptr<FileCacheItem> peekFile(const std::string &path);
+    /**
+     * @brief Drop a cached file, the next request loads it again
+     * 
+     * @param path file path
+     */
+    void invalidate(const std::string &path);
+    /**
+     * @brief Drop every cached file whose path starts with prefix, used when a directory is moved or deleted
+     * 
+     * @param prefix path prefix
+     */
+    void invalidatePrefix(const std::string &prefix);
     off_t getCurrentSize();
     int getCurrentItemCount();
+    /**
+     * @brief Set how often a cached entry is checked against the file system
+     * 
+     * @param interval a hit stats the file only if the entry was last validated longer ago than this, 0 checks on every hit
+     */
+    void setRevalidateInterval(std::chrono::milliseconds interval);
+    /**
+     * @brief Never check cached entries on a hit, for deployments whose files do not change in place
+     * 
+     * @param trust true to trust the cache
+     */
+    void setTrustCache(bool trust);
+    /**
+     * @brief Derive ETags from a hash of the content instead of mtime and size, applies to files loaded afterwards
+     * 
+     * @param hash true to hash files held in memory, fd-backed files always use mtime and size
+     */
+    void setHashETag(bool hash);
+    /**
+     * @brief Look for precompressed siblings (.br, .zst, .gz) when a file is loaded, applies to files loaded afterwards
+     * 
+     * Siblings older than the file are ignored. They are cached together with the file, so picking one is a lookup
+     * in the item, and a change to a sibling reported by invalidate() drops the file as well.
+     * 
+     * @param precompressed true to look for siblings
+     */
+    void setPrecompressed(bool precompressed);
+    /**
+     * @brief Compress cached files on demand in a background thread, the results are cached as separate entries
+     * 
+     * Encodings not supported by this build are skipped. The thread is started on the first call with an encoding.
+     * 
+     * @param encodings encodings to produce
+     * @param min_size smaller files are not worth compressing
+     * @param max_size larger files are not compressed
+     */
+    void setCompression(const std::vector<HTTPHeaderParser::Encoding> &encodings, off_t min_size, off_t max_size);
+    /**
+     * @brief Whether getCompressed() may ever return a copy of the item, responses for it then vary on Accept-Encoding
+     * 
+     * @param item a file returned by getFile()
+     */
+    bool isCompressible(const FileCacheItem &item) const;
+    /**
+     * @brief Get the compressed copy of a file if it is ready, otherwise queue its compression
+     * 
+     * A copy made from an older version of the file is dropped. The lookup never touches the file system.
+     * 
+     * @param item a file returned by getFile(), the copy must match its ETag
+     * @param encoding wanted encoding
+     * @return std::shared_ptr<FileCacheItem> the compressed copy, or nullptr if it is not ready, not enabled, or not smaller than the file
+     */
+    std::shared_ptr<FileCacheItem> getCompressed(const std::shared_ptr<FileCacheItem> &item, HTTPHeaderParser::Encoding encoding);
+    /**
+     * @brief Replace the table used to pick the Content-Type of loaded files, must be called before the pool is used
+     * 
+     * The type is resolved once per load and kept in the item, the table is read without locking afterwards.
+     * 
+     * @param mime_types built-in types merged with the overrides from the configuration
+     */
+    void setMimeTypes(MimeTypes mime_types);
 
 private:
-    off_t m_maxSize, m_currSize;
+    /**
+     * @brief Key of a compressed copy as its parts, looked up without building the key string
+     * 
+     */
+    struct CompressedKey
+    {
+        std::string_view path;
+        HTTPHeaderParser::Encoding encoding;
+    };
+
+    /**
+     * @brief Hash of a cache key, a compressed copy hashes the same as its key string (path + '\0' + encoding name)
+     * 
+     */
+    struct KeyHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view key) const;
+        size_t operator()(const CompressedKey &key) const;
+        // 路径的哈希与编码名称的哈希混合
+        static size_t combine(size_t path_hash, std::string_view encoding);
+    };
+
+    struct KeyEqual
+    {
+        using is_transparent = void;
+        bool operator()(std::string_view a, std::string_view b) const
+        {
+            return a == b;
+        }
+        bool operator()(const CompressedKey &a, std::string_view b) const;
+        bool operator()(std::string_view a, const CompressedKey &b) const
+        {
+            return (*this)(b, a);
+        }
+    };
+
+    /**
+     * @brief A cached file, linked into the replacement policy of its shard
+     * 
+     * Entries live inside the map nodes, whose addresses are stable, so the policy links
+     * point directly at them and promote/evict are O(1) pointer moves.
+     */
+    struct Entry : CacheNode
+    {
+        // 缓存项在map中的key：文件路径，压缩副本为带有编码标记的路径
+        const std::string *key = nullptr;
+        std::shared_ptr<FileCacheItem> item;
+        // 上一次与文件系统核对的时间
+        std::chrono::steady_clock::time_point validated;
+    };
+
+    using CacheMap = std::unordered_map<std::string, Entry, KeyHash, KeyEqual>;
+
+    /**
+     * @brief A miss that is being loaded outside the shard lock
+     * 
+     * Concurrent requests for the same path wait on the future instead of loading the file again.
+     */
+    struct Loading
+    {
+        std::shared_future<std::shared_ptr<FileCacheItem>> result;
+        // 加载期间文件发生了变化，结果交给等待的线程，但不放入缓存
+        bool cancelled = false;
+    };
+
+    /**
+     * @brief A slice of the cache with its own lock and replacement policy
+     * 
+     */
+    struct alignas(64) Shard
+    {
+        CacheMap cacheMap;
+        std::unordered_map<std::string, Loading> loading;
+        std::unique_ptr<CachePolicy> policy;
+        std::mutex lock;
+    };
+
+    off_t m_maxSize;
     int m_maxItem;
+    // 所有分片的总量，按照它们检查上限，因此上限只是近似满足
+    std::atomic<off_t> m_currSize;
+    std::atomic<int> m_currItem;
+    std::atomic<std::chrono::milliseconds::rep> m_revalidateInterval;
+    std::atomic<bool> m_trust;
+    std::atomic<bool> m_hashETag;
+    std::atomic<bool> m_precompressed;
+    MimeTypes m_mimeTypes;
+    // 小文件的存储，与缓存项共享，缓存项还在使用时它比缓存池存活得更久
+    std::shared_ptr<SlabArena> m_arena;
+    off_t m_sendfileMin;
+    // 不小于这个大小的文件流式发送，取stream_min和max_size + 1中较小的一个
+    off_t m_streamMin;
 
-    std::unordered_map<std::string, std::shared_ptr<FileCacheItem>> m_cacheMap;
-    std::list<std::string> m_cacheOrder; 
-    std::mutex m_lock;
-    
-    void evict();
+    std::vector<Shard> m_shards;
+
+    /**
+     * @brief A file waiting for the compressor thread
+     * 
+     */
+    struct CompressJob
+    {
+        std::string key;
+        std::shared_ptr<FileCacheItem> source;
+        HTTPHeaderParser::Encoding encoding;
+    };
+
+    // 超过这个数量的压缩任务被丢弃，之后的命中会再次请求压缩
+    static constexpr size_t MAX_COMPRESS_JOBS = 1024;
+    std::array<std::atomic<bool>, HTTPHeaderParser::ENCODING_COUNT> m_compress;
+    std::atomic<off_t> m_compressMin;
+    std::atomic<off_t> m_compressMax;
+    std::thread m_compressor;
+    std::mutex m_jobLock;
+    std::condition_variable m_jobCond;
+    std::deque<CompressJob> m_jobs;
+    // 正在排队或者正在压缩的key
+    std::unordered_set<std::string, KeyHash, KeyEqual> m_queued;
+    bool m_stopping = false;
+
+    /**
+     * @brief Ask the shard policy for victims until the global limits hold
+     * 
+     * @param shard shard to evict from, must be locked by the caller
+     * @param inserted entry that was just inserted, the policy may reject it
+     */
+    void evict(Shard &shard, Entry *inserted);
+    /**
+     * @brief Remove an entry from the shard and update the totals
+     * 
+     * @param shard shard holding the entry, must be locked by the caller
+     * @param it entry to remove
+     */
+    void erase(Shard &shard, CacheMap::iterator it);
+    /**
+     * @brief Find a cached entry that can be served, stats the file outside the lock when the entry is due for revalidation
+     * 
+     * @param shard shard of the path
+     * @param locker lock of the shard, held on entry and on return but released around the stat
+     * @param path file path
+     * @return std::shared_ptr<FileCacheItem> cached file, or nullptr if the file is not cached or outdated (outdated entries are removed)
+     */
+    std::shared_ptr<FileCacheItem> lookup(Shard &shard, std::unique_lock<std::mutex> &locker, const std::string &path);
+    /**
+     * @brief Check whether an entry can be served without a stat
+     * 
+     * @param entry cached entry, must be locked by the caller
+     * @return true if the cache is trusted or the entry was validated within the interval
+     */
+    bool isFresh(const Entry &entry);
+    /**
+     * @brief Load the precompressed siblings of a freshly loaded file
+     * 
+     * @param path file path
+     * @param item the file, not shared yet
+     */
+    void loadVariants(const std::string &path, FileCacheItem &item);
+    /**
+     * @brief Render the response headers of a freshly loaded file and of its precompressed siblings
+     * 
+     * @param path file path, its extension gives the MIME type
+     * @param item the file, not shared yet
+     */
+    void setResponseHeaders(const std::string &path, FileCacheItem &item);
+    /**
+     * @brief Drop a single cached path and cancel its in-flight load
+     * 
+     * @param path file path
+     */
+    void invalidateOne(const std::string &path);
+    /**
+     * @brief Cache key of the compressed copy of a file, cannot collide with a file path
+     * 
+     */
+    static std::string compressedKey(const std::string &path, HTTPHeaderParser::Encoding encoding);
+    /**
+     * @brief Insert an item into its shard, replacing an entry with the same key, then evict
+     * 
+     * @param key cache key
+     * @param item the item, not cached yet
+     */
+    void insert(Shard &shard, const std::string &key, uint64_t hash, std::shared_ptr<FileCacheItem> item);
+    /**
+     * @brief Main loop of the compressor thread
+     * 
+     */
+    void compressLoop();
+    /**
+     * @brief Compress one file outside any lock and cache the result
+     * 
+     */
+    void compress(const CompressJob &job);
     bool compareTimeSpec(const struct timespec& t1, const struct timespec& t2);
     bool fileConsistencyCheck(const std::string &path, const struct stat& old_fstat);
+    /**
+     * @brief Check that the precompressed siblings are the ones seen when the item was loaded
+     * 
+     * @param path path of the identity file
+     * @param item the cached item
+     * @return false if a sibling changed, disappeared or appeared since the load
+     */
+    bool siblingConsistencyCheck(const std::string &path, const FileCacheItem &item);
 };
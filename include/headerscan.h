@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+// 请求头分隔符的查找，按照CPU支持的指令集选择实现：AVX2每次比较32个字节，SSE2每次比较16个字节，其他平台逐字节比较
+namespace HeaderScan
+{
+    enum class Impl
+    {
+        SCALAR,
+        SSE2,
+        AVX2
+    };
+
+    // 当前CPU是否支持该实现
+    bool isSupported(Impl impl);
+    // 切换find使用的实现，不支持时返回false并保持原来的实现；只应在启动时或者测试、基准测试中调用
+    bool select(Impl impl);
+    // find当前使用的实现，启动时选择CPU支持的最快实现
+    Impl selected();
+    // 返回data开始的len个字节中第一个等于a或者b的字符的偏移，没有时返回len；只查找一个字符时a和b相同
+    size_t find(const char *data, size_t len, char a, char b);
+    // 使用指定的实现查找，用于测试和基准测试，impl必须被当前CPU支持
+    size_t find(Impl impl, const char *data, size_t len, char a, char b);
+}
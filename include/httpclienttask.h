@@ -8,11 +8,16 @@
 #include "utils.h"
 #include "constants.h"
 #include <atomic>
+#include <chrono>
+#include <deque>
 #include <filesystem>
+#include <optional>
 
 #include <netinet/in.h>
 #include <stdio.h>
 #include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/uio.h>
 
@@ -22,42 +27,132 @@ public:
     enum class TaskContext
     {
         IN,
+        // 请求头已经解析完成，只需要生成响应
+        RESPOND,
         OUT,
         CLOSE
     };
 
+    // 连接当前所处的阶段，不同阶段使用不同的超时时间
+    enum class Phase
+    {
+        // 等待新的请求
+        IDLE,
+        // 已经收到请求的一部分，等待完整的请求头
+        HEADER,
+        // 正在生成或者写入响应
+        WRITE
+    };
+
     HTTPClientTask(/* args */);
     ~HTTPClientTask();
     // 在任务队列中调用的处理函数
     void process(TaskContext context);
-    // 初始化一个连接
-    void init(int sockfd, sockaddr_in& addr);
+    // 处理属于第generation代连接的任务，fd已经被关闭并复用时直接丢弃
+    void process(TaskContext context, uint32_t generation);
+    // 生成交给线程池的定长任务记录，记录中包含连接当前的代数
+    ThreadPool::Task makeTask(TaskContext context);
+    // 在事件循环中直接处理读取事件，请求的文件在缓存中、不需要重新验证并且内容在内存中时直接写入响应
+    // 返回需要交给线程池继续处理的任务，std::nullopt代表已经处理完成
+    // overloaded为true时不会在已经生成响应之后返回任务：无法直接响应的请求在前面的响应之后得到503，随后关闭连接
+    std::optional<TaskContext> processInline(bool overloaded = false);
+    // 服务器过载时在事件循环中拒绝请求：返回预先生成的503响应并关闭连接
+    // 连接正在被其他线程处理时返回false
+    bool reject();
+    // 初始化一个连接，连接注册在epfd对应的事件循环上，并在整个生命周期内由其负责
+    void init(int sockfd, sockaddr_in& addr, int epfd);
     // 断开与客户端之间的连接
     void close();
+    // 获取连接所属事件循环的epoll描述符，连接关闭后返回-1
+    int getEpfd() const;
+    Phase getPhase() const;
+    // 根据当前阶段和阶段内最后一次活动的时间计算连接的超时时间点，连接关闭后返回std::nullopt
+    std::optional<std::chrono::high_resolution_clock::time_point> getDeadline() const;
 
-    static int s_epfd;
     static std::atomic<int> s_userCnt;
     static std::filesystem::path s_docRoot;
     static std::shared_ptr<FileCachePool> s_pool;
     static std::vector<std::mutex> s_client_lock;
     static std::shared_ptr<spdlog::logger> s_logger;
+    // 各个阶段的超时时间
+    static std::chrono::milliseconds s_idleTimeout;
+    static std::chrono::milliseconds s_headerTimeout;
+    static std::chrono::milliseconds s_writeTimeout;
 
 private:
-    HTTPHeaderParser m_parser;
+    // 请求头只以视图的形式保存在m_readBuf中，解析请求不分配内存
+    HTTPHeaderParser m_parser{HTTPHeaderParser::Mode::VIEW};
     int m_sockfd = -1;
+    int m_epfd = -1;
+    // 连接的代数，每次init时+1，用于识别fd被复用之前提交的任务
+    std::atomic<uint32_t> m_generation = 0;
     sockaddr_in m_addr;
     std::array<char, READ_BUFFER_SIZE> m_readBuf;
-    int m_readIdx;
-    int m_remainBytes;
+    int m_readIdx = 0;
+    // 正在解析的请求在m_readBuf中的起始位置，之前的请求都已经生成了响应（HTTP/1.1流水线）
+    int m_parsedIdx = 0;
+
+    // 由工作线程更新，由事件循环在计时器到期时读取
+    std::atomic<Phase> m_phase = Phase::IDLE;
+    std::atomic<std::chrono::high_resolution_clock::rep> m_lastActive = 0;
 
-    std::string* m_respond_header = nullptr;
     bool m_keep_connection = false;
-    
-    iovec m_iv[2];
+    bool m_badRequest = false;
+    std::string m_docPath;
+    // 请求中的Range、If-Range、条件请求头和Accept-Encoding，没有时为空
+    // 指向m_readBuf，在生成响应之前不会被下一次读取或者缓冲区的整理覆盖
+    std::string_view m_range;
+    std::string_view m_ifRange;
+    std::string_view m_ifNoneMatch;
+    std::string_view m_ifModifiedSince;
+    std::string_view m_acceptEncoding;
+
+    // 待发送的响应片段：data不为nullptr时为内存中的数据，否则为file的文件描述符中从offset开始的数据
+    // 长度使用64位，文件可能超过2GB
+    struct Segment
+    {
+        const char *data;
+        off_t offset;
+        off_t length;
+        const FileCacheItem *file;
+    };
+    // 已经生成、等待发送的一个响应，片段引用的数据都保存在这里，直到这一批响应全部发送完毕
+    struct Response
+    {
+        std::shared_ptr<FileCacheItem> file;
+        // 快速路径之外生成的响应头
+        std::string header;
+        // multipart/byteranges中每个部分的头和结尾的分隔符
+        std::string partHeaders;
+        // 快速路径中拼接在预生成的响应头之后的Date、Connection和空行
+        char tail[96];
+    };
+    // 流水线中的多个请求的响应按照顺序排在一起，内存中的片段由一次sendmsg发送
+    // 使用deque，添加新的响应时已有响应的地址不变
+    std::deque<Response> m_responses;
+    std::vector<Segment> m_segments;
+    size_t m_segmentIdx = 0;
 
+    // 正在生成响应的请求的文件，生成之后移动到对应的Response中
     std::shared_ptr<FileCacheItem> m_fcont;
     
     void processRead();
     void processWrite();
+    // 读取并格式化请求头，返回true代表请求头已经完整
+    bool readRequest();
+    // 解析缓冲区中紧接着上一个请求的流水线请求，返回true代表又有一个完整的请求
+    bool nextRequest();
+    // 从m_parsedIdx开始解析，请求完整时取出请求中的字段，不完整时把它移动到缓冲区的开头
+    HTTPHeaderParser::Status parseRequest();
+    // 从缓存池获取文件，为缓冲区中全部完整的请求生成响应并注册写入事件
+    void respond();
+    // 根据m_fcont生成响应头，把待写入的数据添加到m_segments的末尾
+    void prepareRespond();
+    // 添加文件中[offset, offset + length)的内容作为待发送的片段，内存中的文件直接引用缓存的数据，否则使用sendfile
+    void addFileSegment(off_t offset, off_t length);
     bool read();
+    // 进入新的阶段，或者在当前阶段内有了新的进展
+    void touch(Phase phase);
+    // 线程池调用的任务入口
+    static void runTask(void *client, int context, uint32_t generation);
 };
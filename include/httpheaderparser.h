@@ -1,8 +1,14 @@
 #pragma once
 
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <array>
+#include <ctime>
 #include <vector>
 #include <map>
 #include <string>
+#include <string_view>
 #include <optional>
 
 class HTTPHeaderParser
@@ -34,6 +40,7 @@ public:
     {
         CONTINUE,
         OK,
+        PARTIAL_CONTENT,
         MOVED_PERMANENTLY,
         FOUND,
         NOT_MODIFIED,
@@ -43,10 +50,20 @@ public:
         FORBIDDEN,    
         NOT_FOUND,
         PROXY_AUTHENTICATION_REQUIRED,
+        RANGE_NOT_SATISFIABLE,
         INTERNAL_SERVER_ERROR,
         SERVICE_UNAVAILABLE
     };
 
+    // 支持的内容编码，按照服务器的偏好排列，同时作为预压缩文件数组的下标
+    enum class Encoding
+    {
+        BR,
+        ZSTD,
+        GZIP
+    };
+    static constexpr size_t ENCODING_COUNT = 3;
+
     struct RequestHeader
     {
         Method method;
@@ -55,7 +72,99 @@ public:
         KVMap opt;
     };
 
-    HTTPHeaderParser();
+    // 请求头的保存方式
+    enum class Mode
+    {
+        // 复制到RequestHeader的std::string和KVMap中，之后可以随意修改缓冲区
+        MAP,
+        // 只在RequestView中记录指向缓冲区的std::string_view，不分配内存，缓冲区被覆盖之前有效
+        VIEW
+    };
+
+    // 有专门下标的请求头字段，名称大小写不敏感
+    enum class Field
+    {
+        HOST,
+        CONNECTION,
+        RANGE,
+        IF_RANGE,
+        IF_NONE_MATCH,
+        IF_MODIFIED_SINCE,
+        ACCEPT_ENCODING,
+        CONTENT_LENGTH,
+        TRANSFER_ENCODING,
+        USER_AGENT,
+        UNKNOWN
+    };
+    static constexpr size_t FIELD_COUNT = static_cast<size_t>(Field::UNKNOWN);
+
+    // RequestView中按顺序保存的请求头数量，超出的请求头只能通过已知字段或者MAP模式的映射访问
+    static constexpr size_t MAX_HEADER_COUNT = 32;
+
+    struct HeaderField
+    {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    struct RequestView
+    {
+        Method method;
+        std::string_view version;
+        std::string_view path;
+        // 按照出现的顺序保存前MAX_HEADER_COUNT个请求头
+        std::array<HeaderField, MAX_HEADER_COUNT> headers;
+        size_t count = 0;
+        // 已知字段的值，没有出现时为空，重复出现时为最后一个
+        std::array<std::string_view, FIELD_COUNT> fields;
+
+        std::string_view get(Field field) const
+        {
+            return fields[static_cast<size_t>(field)];
+        }
+        // 按照名称查找，大小写不敏感，没有找到时返回空
+        std::string_view find(std::string_view name) const;
+    };
+
+    // 按照偏好排列的编码，容量固定为ENCODING_COUNT，不分配内存
+    struct EncodingList
+    {
+        std::array<Encoding, ENCODING_COUNT> items{};
+        size_t count = 0;
+
+        const Encoding *begin() const
+        {
+            return items.data();
+        }
+        const Encoding *end() const
+        {
+            return items.data() + count;
+        }
+        size_t size() const
+        {
+            return count;
+        }
+        bool empty() const
+        {
+            return count == 0;
+        }
+        Encoding front() const
+        {
+            return items[0];
+        }
+    };
+
+    // 闭区间[first, last]，以字节为单位
+    struct ByteRange
+    {
+        off_t first;
+        off_t last;
+    };
+
+    // 单个请求最多可以包含的区间数量，超出时忽略Range
+    static constexpr size_t MAX_RANGE_COUNT = 16;
+
+    explicit HTTPHeaderParser(Mode mode = Mode::MAP);
     ~HTTPHeaderParser();
     // 重置全部内部状态，但不更改m_buf指向的地址
     void reset();
@@ -66,10 +175,49 @@ public:
     // 返回DONE代表格式化完成
     // 返回ERROR代表请求头中有错误
     Status parseRequest(int read_pos);
-    // 获取指向请求头的指针
+    // 请求头的长度（包括最后的空行），只在parseRequest返回DONE之后有效；同一个缓冲区中流水线的下一个请求从这里开始
+    int getRequestSize() const;
+    // 缓冲区中的数据被整体移动到buf之后调用，保留解析的进度，视图改为指向新的位置
+    void moveBuffer(char* buf);
+    // 获取指向请求头的指针，只在MAP模式下填写
     RequestHeader* getRequestHeader();
+    // 获取指向缓冲区的请求头视图，两种模式下都会填写
+    const RequestView* getRequestView() const;
     // 根据返回状态生成响应头，返回字符串指针
-    std::string* getRespondHeader(std::string version, StatusCode code, std::optional<KVMap> opt);
+    // 200、206和304之外的状态码在opt之后附加一个以状态码为内容的响应体
+    std::string* getRespondHeader(std::string_view version, StatusCode code, const KVMap &opt);
+    // 与getRespondHeader相同，但是把响应头追加到out的末尾，不复制参数，也不经过内部的缓冲区
+    static void appendRespondHeader(std::string &out, std::string_view version, StatusCode code, const KVMap &opt);
+
+    // 解析Range请求头的值，size为文件的大小
+    // 返回std::nullopt代表应当忽略Range并返回整个文件（格式错误、不是bytes单位、区间过多或者区间的总长度超过文件本身），返回空数组代表没有可以满足的区间
+    static std::optional<std::vector<ByteRange>> parseRange(std::string_view value, off_t size);
+    // 按照IMF-fixdate格式化时间，例如Sun, 06 Nov 1994 08:49:37 GMT
+    static std::string formatDate(time_t time);
+    // 当前时间的"Date: ...\r\n"响应头，同一秒内的结果缓存在线程局部变量中，调用者需要在同一个线程中复制走
+    static const std::string &currentDateHeader();
+    // 根据文件的修改时间和大小生成强验证的ETag
+    static std::string makeETag(const struct stat &fstat);
+    // If-Range的值与文件当前的ETag或者Last-Modified完全相同时返回true，此时才能按照Range返回部分内容
+    static bool ifRangeMatches(std::string_view value, std::string_view etag, std::string_view last_modified);
+    // 解析Accept-Encoding，按照q值从高到低返回客户端可以接受的编码，q值相同时按照服务器的偏好排列，不包括identity
+    static EncodingList parseAcceptEncoding(std::string_view value);
+    // Content-Encoding中使用的名称，例如gzip
+    static const char *encoding2str(Encoding encoding);
+    // 预压缩文件的后缀名，例如.gz
+    static const char *encodingExtension(Encoding encoding);
+    // MIME类型是否值得压缩，文本类型压缩效果好，图片、音视频和压缩包已经压缩过
+    static bool isCompressibleType(std::string_view content_type);
+    // 根据名称查找已知的请求头字段，大小写不敏感，不是已知字段时返回UNKNOWN
+    static Field str2field(std::string_view name);
+    // 解析HTTP日期，支持IMF-fixdate、RFC 850和asctime三种格式，无效时返回std::nullopt
+    static std::optional<time_t> parseDate(std::string_view value);
+    // If-None-Match中的任意一个ETag与etag弱比较相同，或者为*时返回true
+    static bool ifNoneMatchMatches(std::string_view value, std::string_view etag);
+    // 逗号分隔的列表（例如Connection的值）中含有token时返回true，不区分大小写
+    static bool hasToken(std::string_view value, std::string_view token);
+    // 按照请求的版本和Connection判断响应之后是否保持连接：HTTP/1.1默认保持，除非带有close；HTTP/1.0只在带有keep-alive时保持
+    static bool keepAlive(std::string_view version, std::string_view connection);
 
 private:
     enum class _InternalStatus
@@ -89,15 +237,18 @@ private:
     int m_parsePos;
     int m_readPos;
     int m_lineStartPos;
-    int m_headerFieldValueStartPos;
+    // 当前行中第一个冒号的位置，还没有出现时不大于m_lineStartPos
+    int m_headerColonPos;
+    Mode m_mode;
     _InternalStatus m_parseStatus;
     _InternalLineStatus m_parseLineStatus;
     RequestHeader m_requestHeader;
+    RequestView m_requestView;
     std::string m_respondHeader;
 
     _InternalLineStatus parseLine();
     bool parseStartLine();
     
-    static Method str2method(const std::string& str);
-    static std::string status2str(StatusCode status);
+    static Method str2method(std::string_view str);
+    static std::string_view status2str(StatusCode status);
 };
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// 编译期生成的完美哈希表，键的比较和哈希都不区分大小写
+// 第一次哈希把键分到与槽位数量相同的桶中，每个桶记录一个位移：多个键的桶使用位移作为种子再哈希一次，找到一个使它们都落在空槽位中的种子；
+// 只有一个键的桶直接记录槽位的下标。查找时最多计算两次哈希、比较一次字符串，不分配内存
+template <size_t N>
+class PerfectHashTable
+{
+public:
+    using Entry = std::pair<std::string_view, std::string_view>;
+
+    // 键重复（不区分大小写）或者找不到可用的种子时无法在编译期求值
+    consteval explicit PerfectHashTable(const Entry (&entries)[N])
+    {
+        std::array<size_t, SIZE> bucket_sizes{};
+        for (auto &entry : entries)
+        {
+            bucket_sizes[hash(entry.first, 0) & MASK]++;
+        }
+        size_t max_bucket = 0;
+        for (auto size : bucket_sizes)
+        {
+            max_bucket = std::max(max_bucket, size);
+        }
+        std::array<bool, SIZE> used{};
+        // 先放置较大的桶，此时空槽位较多，容易找到种子
+        for (size_t size = max_bucket; size > 1; size--)
+        {
+            for (size_t bucket = 0; bucket < SIZE; bucket++)
+            {
+                if (bucket_sizes[bucket] == size)
+                    place(entries, bucket, size, used);
+            }
+        }
+        // 只有一个键的桶依次放入剩下的槽位
+        size_t free_slot = 0;
+        for (auto &entry : entries)
+        {
+            size_t bucket = hash(entry.first, 0) & MASK;
+            if (bucket_sizes[bucket] != 1)
+                continue;
+            while (used[free_slot])
+            {
+                free_slot++;
+            }
+            used[free_slot] = true;
+            m_slots[free_slot] = entry;
+            m_displace[bucket] = -static_cast<int32_t>(free_slot) - 1;
+        }
+    }
+
+    // 返回键对应的值，不存在时返回空
+    constexpr std::string_view find(std::string_view key) const
+    {
+        int32_t displace = m_displace[hash(key, 0) & MASK];
+        if (displace == 0)
+            return {};
+        size_t slot = displace < 0 ? static_cast<size_t>(-displace - 1) : hash(key, displace) & MASK;
+        return iequals(m_slots[slot].first, key) ? m_slots[slot].second : std::string_view();
+    }
+
+    static constexpr size_t size()
+    {
+        return N;
+    }
+
+    static constexpr char tolower(char c)
+    {
+        return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+    }
+
+    static constexpr bool iequals(std::string_view a, std::string_view b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            if (tolower(a[i]) != tolower(b[i]))
+                return false;
+        }
+        return true;
+    }
+
+private:
+    // 槽位数量为不小于N的2的幂，负载不低于50%
+    static constexpr size_t SIZE = std::bit_ceil(N);
+    static constexpr size_t MASK = SIZE - 1;
+    // 单个桶尝试的种子数量上限
+    static constexpr int32_t MAX_SEED = 1 << 16;
+    // 单个桶中键的数量上限，哈希均匀时远远达不到
+    static constexpr size_t MAX_BUCKET = 16;
+
+    std::array<Entry, SIZE> m_slots{};
+    // 0代表空桶，正数为再哈希的种子，负数为-(槽位下标+1)
+    std::array<int32_t, SIZE> m_displace{};
+
+    // 带种子的FNV-1a，最后混合高位，使按掩码取低位时分布均匀
+    static constexpr uint64_t hash(std::string_view key, int32_t seed)
+    {
+        uint64_t h = 0xcbf29ce484222325ull ^ (static_cast<uint64_t>(seed) * 0x9e3779b97f4a7c15ull);
+        for (char c : key)
+        {
+            h ^= static_cast<unsigned char>(tolower(c));
+            h *= 0x100000001b3ull;
+        }
+        h ^= h >> 29;
+        h *= 0xbf58476d1ce4e5b9ull;
+        h ^= h >> 32;
+        return h;
+    }
+
+    consteval void place(const Entry (&entries)[N], size_t bucket, size_t size, std::array<bool, SIZE> &used)
+    {
+        if (size > MAX_BUCKET)
+            throw "bucket too large";
+        std::array<const Entry *, MAX_BUCKET> members{};
+        size_t count = 0;
+        for (auto &entry : entries)
+        {
+            if ((hash(entry.first, 0) & MASK) == bucket)
+                members[count++] = &entry;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            for (size_t j = i + 1; j < count; j++)
+            {
+                if (iequals(members[i]->first, members[j]->first))
+                    throw "duplicate key";
+            }
+        }
+        for (int32_t seed = 1; seed < MAX_SEED; seed++)
+        {
+            std::array<size_t, MAX_BUCKET> slots{};
+            bool ok = true;
+            for (size_t i = 0; i < count && ok; i++)
+            {
+                slots[i] = hash(members[i]->first, seed) & MASK;
+                ok = !used[slots[i]];
+                for (size_t j = 0; j < i && ok; j++)
+                {
+                    ok = slots[j] != slots[i];
+                }
+            }
+            if (!ok)
+                continue;
+            for (size_t i = 0; i < count; i++)
+            {
+                used[slots[i]] = true;
+                m_slots[slots[i]] = *members[i];
+            }
+            m_displace[bucket] = seed;
+            return;
+        }
+        throw "no seed found";
+    }
+};
+
+// 根据文件的后缀名确定MIME类型，内置的类型表在编译期生成，启动时可以用配置覆盖或者补充
+// 构造之后只读，可以在多个线程中同时查找
+class MimeTypes
+{
+public:
+    // 没有匹配的后缀名时使用的类型
+    static constexpr std::string_view DEFAULT_TYPE = "application/unknown";
+
+    MimeTypes() = default;
+    // overrides中的后缀名可以省略开头的点，不区分大小写，优先于内置的类型；同一个后缀名出现多次时使用最后一个
+    explicit MimeTypes(const std::vector<std::pair<std::string, std::string>> &overrides);
+
+    // 根据后缀名（包括开头的点）查找，不区分大小写，没有匹配时返回DEFAULT_TYPE
+    std::string_view lookup(std::string_view extension) const;
+    // 根据路径中文件名的后缀名查找
+    std::string_view lookupPath(std::string_view path) const;
+    size_t overrideCount() const;
+
+    // 只在内置的类型中查找，没有匹配时返回空
+    static std::string_view builtin(std::string_view extension);
+    // 返回路径中文件名的后缀名（包括开头的点），没有后缀名或者文件名以点开头且只有一个点时返回空，与std::filesystem::path::extension相同
+    static std::string_view extension(std::string_view path);
+
+private:
+    // 按照小写的后缀名排序，通常为空或者只有几项
+    std::vector<std::pair<std::string, std::string>> m_overrides;
+};
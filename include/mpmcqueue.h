@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// 有界的无锁多生产者多消费者队列（Vyukov）
+// 每个槽位带有一个序号，生产者和消费者只在各自的位置计数器上竞争，不需要互斥锁
+template <typename T>
+class MPMCQueue
+{
+private:
+    struct Cell
+    {
+        // 序号等于pos时槽位可写，等于pos+1时槽位可读
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> m_buffer;
+    size_t m_capacity;
+    // 生产者和消费者的位置分别放在独立的缓存行中，避免伪共享
+    alignas(64) std::atomic<size_t> m_enqueuePos;
+    alignas(64) std::atomic<size_t> m_dequeuePos;
+
+public:
+    explicit MPMCQueue(size_t capacity)
+        : m_buffer(new Cell[capacity]), m_capacity(capacity), m_enqueuePos(0), m_dequeuePos(0)
+    {
+        for (size_t i = 0; i < capacity; i++)
+        {
+            m_buffer[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MPMCQueue(const MPMCQueue &) = delete;
+    MPMCQueue &operator=(const MPMCQueue &) = delete;
+
+    // 入队，队列已满时返回false
+    bool push(const T &data)
+    {
+        Cell *cell;
+        size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &m_buffer[pos % m_capacity];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                // 槽位中还有上一轮没有被取走的数据
+                return false;
+            }
+            else
+            {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = data;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 出队，队列为空时返回false
+    bool pop(T &data)
+    {
+        Cell *cell;
+        size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &m_buffer[pos % m_capacity];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        data = std::move(cell->data);
+        cell->sequence.store(pos + m_capacity, std::memory_order_release);
+        return true;
+    }
+
+    // 队列中元素数量的近似值，并发修改时只作为参考
+    size_t size() const
+    {
+        size_t enqueue_pos = m_enqueuePos.load(std::memory_order_relaxed);
+        size_t dequeue_pos = m_dequeuePos.load(std::memory_order_relaxed);
+        return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+    }
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <sys/mman.h>
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// 小文件的分级内存池：按照大小分为若干级，每一级从大块的匿名映射（slab）中切出固定大小的块，紧密排列
+// 释放的块放入所在slab的空闲链表中复用，slab中的块全部被释放后立即归还系统，保留的内存不会超过仍在使用的slab
+// 大小级别在每个2的幂之间再均分为4级，块内的浪费不超过25%
+class SlabArena
+{
+public:
+    // max_block为可以分配的最大字节数，slab_size为每次向系统申请的字节数，向上取整为2的幂
+    explicit SlabArena(size_t max_block, size_t slab_size = 1024 * 1024);
+    ~SlabArena();
+    SlabArena(const SlabArena &) = delete;
+    SlabArena &operator=(const SlabArena &) = delete;
+
+    // 分配至少size字节，size为0或者超过max_block时返回nullptr，线程安全
+    void *allocate(size_t size);
+    // 释放allocate返回的块，size必须与分配时相同，线程安全
+    void deallocate(void *ptr, size_t size);
+    // size所在级别的块大小，即分配size字节实际占用的内存，超出范围时返回0
+    size_t blockSize(size_t size) const;
+    size_t maxBlock() const;
+    // 已经从系统申请的字节数
+    size_t getReservedSize();
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock *next;
+    };
+
+    // slab的元数据保存在slab之外，slab按照自身的大小对齐，块的地址去掉低位就是所在slab的地址
+    struct Slab
+    {
+        FreeBlock *freeList = nullptr;
+        // 还没有被切分的部分
+        char *cursor = nullptr;
+        char *end = nullptr;
+        // 已经分配出去的块的数量，为0时slab被归还
+        size_t live = 0;
+        // 还有空闲块的slab组成双向链表，分配时从链表头部取
+        Slab *prev = nullptr;
+        Slab *next = nullptr;
+        bool partial = false;
+    };
+
+    struct SizeClass
+    {
+        size_t blockSize = 0;
+        std::mutex lock;
+        Slab *partial = nullptr;
+        std::unordered_map<char *, Slab> slabs;
+    };
+
+    size_t m_maxBlock;
+    size_t m_slabSize;
+    std::vector<size_t> m_blockSizes;
+    std::unique_ptr<SizeClass[]> m_classes;
+
+    // size所在级别的下标，超出范围时返回-1
+    int classIndex(size_t size) const;
+    // 申请一块按照m_slabSize对齐的匿名映射，失败时返回nullptr
+    char *mapSlab();
+    static void linkPartial(SizeClass &sc, Slab &slab);
+    static void unlinkPartial(SizeClass &sc, Slab &slab);
+};
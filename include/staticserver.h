@@ -7,6 +7,11 @@
 #include <sys/epoll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <sys/eventfd.h>
+
+#include <atomic>
+#include <deque>
+#include <thread>
 
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
@@ -16,6 +21,7 @@
 #include "httpclienttask.h"
 #include "hashedwheeltimer.h"
 #include "filecachepool.h"
+#include "docrootwatcher.h"
 #include "utils.h"
 
 class StaticServer
@@ -32,24 +38,68 @@ public:
     static std::shared_ptr<spdlog::logger> s_logger;
 
 private:
+    // 运行模式
+    enum class Mode
+    {
+        // 单个反应堆 + 线程池，事件交给线程池处理
+        POOL,
+        // 每个线程一个反应堆，连接在所属的反应堆上直接处理
+        MULTI_REACTOR
+    };
+
+    // 一个事件循环拥有的全部资源，连接在整个生命周期内只属于一个事件循环
+    struct Reactor
+    {
+        int epfd = -1;
+        int listenfd = -1;
+        // 用于唤醒epoll_wait的eventfd，停止服务器时使用
+        int wakefd = -1;
+        // 驱动时间轮的timerfd
+        int timerfd = -1;
+        std::shared_ptr<HashedWheelTimer> timer;
+        // 以fd为下标的连接计时器，每个事件循环独立，避免fd被其他事件循环复用时共享计时器
+        std::vector<Timer> timers;
+        std::vector<epoll_event> epevents;
+        std::thread thread;
+    };
+
     std::vector<HTTPClientTask> m_clients;
-    std::vector<Timer> m_timers;
-    std::vector<epoll_event> m_epevents;
+    std::vector<Reactor> m_reactors;
     sockaddr_in m_addr;
     
-    int m_epfd;
-    int m_listenfd;
-    int m_timerinterval;
-    int m_connection_timeout;
-    bool m_stop_server = false, m_timeout_flag = false;
+    Mode m_mode = Mode::POOL;
+    // 在事件循环中直接处理缓存命中的请求
+    bool m_inline = false;
+    // 任务队列的高水位，超过后暂停接受连接并拒绝新的请求
+    int m_highwater;
+    bool m_acceptPaused = false;
+    // 由于任务队列已满而被推迟的任务
+    std::deque<std::pair<int, ThreadPool::Task>> m_retryTasks;
+    int m_backlog;
+    std::atomic<bool> m_stop_server = false;
 
     std::shared_ptr<ThreadPool> m_tp;
     std::shared_ptr<FileCachePool> m_fp;
-    std::shared_ptr<HashedWheelTimer> m_timer;
+    std::shared_ptr<DocRootWatcher> m_watcher;
 
     StaticServer();
     static StaticServer* s_instance;
     static int s_fd_sigpipe[2];
     static void sighandler(int sig);
-    void timeoutcb(HTTPClientTask *client);
+    // 创建监听socket，reuseport为true时设置SO_REUSEPORT，由内核在多个监听socket之间分配连接
+    int createListenSocket(bool reuseport);
+    // 事件循环的主体
+    void reactorLoop(Reactor &reactor);
+    // 处理监听socket上的新连接
+    void acceptConnections(Reactor &reactor);
+    // 将连接上的事件交给线程池或者在当前事件循环中直接处理
+    void dispatch(int fd, HTTPClientTask::TaskContext context);
+    // 任务队列是否超过了高水位
+    bool isOverloaded();
+    // 过载时拒绝连接上的请求
+    void shed(Reactor &reactor, int fd);
+    // 重试被推迟的任务，并在负载下降后恢复接受连接
+    void retryDeferred(Reactor &reactor);
+    // 连接的计时器到期，检查连接是否真的超时
+    void timeoutcb(Reactor *reactor, int fd);
 };
@@ -1,35 +1,89 @@
 #pragma once
 
 #include <thread>
-#include <semaphore>
-#include <mutex>
+#include <atomic>
 
 #include <vector>
-#include <queue>
+#include <memory>
 #include <functional>
+#include <cstdint>
+
+#include "mpmcqueue.h"
 
 class ThreadPool
 {
+public:
+    // 定长的任务记录，入队和出队都不需要分配内存
+    // 工作线程调用handler(obj, arg, generation)，generation由调用者用于识别过期的任务
+    struct Task
+    {
+        void (*handler)(void *obj, int arg, uint32_t generation) = nullptr;
+        void *obj = nullptr;
+        int arg = 0;
+        uint32_t generation = 0;
+    };
+
+    // 任务的调度方式
+    enum class Scheduler
+    {
+        // 所有工作线程共享一个任务队列
+        SHARED,
+        // 每个工作线程有自己的任务队列，任务按照affinity分配给固定的工作线程，空闲的工作线程从其他队列中窃取任务
+        STEALING
+    };
+
 private:
+    // 空闲的工作线程在休眠前尝试获取任务的次数
+    static constexpr int SPIN_COUNT = 256;
+
+    // 工作线程的休眠状态，每个工作线程在自己的唤醒计数上等待，可以被单独唤醒
+    struct Worker
+    {
+        alignas(64) std::atomic<uint32_t> wakeup = 0;
+        std::atomic<bool> sleeping = false;
+    };
+
     std::vector<std::thread> m_threads;
-    std::queue<std::function<void()>> m_taskQueue;
-    std::mutex m_taskQueueMutex;
-    int m_nrMaxTask;
-    std::counting_semaphore<INT_MAX> m_queueStatus;
-    bool m_stopFlag;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    // 无锁的有界任务队列，SHARED模式下只有一个，STEALING模式下每个工作线程一个，总长度为nr_max_task
+    std::vector<std::unique_ptr<MPMCQueue<Task>>> m_taskQueues;
+    Scheduler m_scheduler = Scheduler::SHARED;
+    // 没有指定affinity的任务轮流分配
+    std::atomic<size_t> m_roundRobin = 0;
+    // 已经提交但是还没有处理完成的任务数量
+    std::atomic<int> m_unfinished = 0;
+    // 正在休眠的工作线程数量，为0时添加任务不需要唤醒
+    std::atomic<int> m_sleepers = 0;
+    std::atomic<bool> m_stopFlag;
+
+    // 通用任务的入口，obj为堆上的std::function
+    static void runClosure(void *obj, int arg, uint32_t generation);
+    // 任务放入了第index个队列，按需唤醒工作线程
+    void notify(size_t index);
+    // 唤醒一个工作线程，线程没有在休眠时返回false
+    bool wake(size_t id);
+    // 第id个工作线程获取一个任务，先从自己的队列获取，然后窃取其他队列中的任务
+    bool pop(size_t id, Task &task);
+    // 获取一个任务，先自旋，然后休眠等待，线程池停止时返回false
+    bool take(size_t id, Task &task);
 
 public:
     ThreadPool();
     ~ThreadPool();
     // 启动线程池，nr_threads个工作线程，任务队列中最多包含nr_max_task和任务
-    void start(int nr_threads, int nr_max_task);
+    void start(int nr_threads, int nr_max_task, Scheduler scheduler = Scheduler::SHARED);
     // 等待任务队列中的所有任务被处理完成
     void wait();
     // 停止线程池
     void stop();
-    // 向任务队列中添加一个任务
+    // 向任务队列中添加一个任务记录，任务队列已满时返回false
+    bool appendTask(const Task &task);
+    // 添加一个任务记录，STEALING模式下affinity相同的任务优先由同一个工作线程处理
+    bool appendTask(const Task &task, size_t affinity);
+    // 向任务队列中添加一个通用任务，需要额外的内存分配，任务队列已满时返回false
     bool appendTask(std::function<void()> task);
+    // 获取任务队列中等待处理的任务数量
+    int getTaskCount();
     // 工作线程的主循环
-    void loop();
+    void loop(size_t id);
 };
-
@@ -7,7 +7,9 @@
 #include <signal.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <sys/timerfd.h>
 #include <string>
+#include <chrono>
 #include <spdlog/spdlog.h>
 
 namespace Utils
@@ -17,7 +19,10 @@ namespace Utils
     int modepfd(int epfd, int fd, uint32_t flag);
     int setfdnonblocking(int fd);
     int setreusefd(int fd, bool on);
+    int setreuseport(int fd, bool on);
     int setsighandler(int signal, sighandler_t handler);
+    // 创建一个按照interval周期性触发的非阻塞timerfd
+    int createtimerfd(std::chrono::milliseconds interval);
     std::string addr2str(sockaddr_in& addr);
     spdlog::level::level_enum str2loglvl(std::string str);
 }
\ No newline at end of file
@@ -0,0 +1,304 @@
+#include "cachepolicy.h"
+
+#include <algorithm>
+
+CacheNodeList::CacheNodeList()
+{
+    m_head.prev = m_head.next = &m_head;
+}
+
+void CacheNodeList::pushFront(CacheNode *node)
+{
+    node->prev = &m_head;
+    node->next = m_head.next;
+    m_head.next->prev = node;
+    m_head.next = node;
+    m_size++;
+}
+
+void CacheNodeList::remove(CacheNode *node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = nullptr;
+    m_size--;
+}
+
+CacheNode *CacheNodeList::front() const
+{
+    return m_size ? m_head.next : nullptr;
+}
+
+CacheNode *CacheNodeList::back() const
+{
+    return m_size ? m_head.prev : nullptr;
+}
+
+size_t CacheNodeList::size() const
+{
+    return m_size;
+}
+
+FrequencySketch::FrequencySketch(size_t capacity)
+{
+    // 每行的宽度取不小于容量的2的幂
+    size_t width = 16;
+    while (width < capacity)
+        width <<= 1;
+    m_table.assign(width * DEPTH, 0);
+    m_mask = width - 1;
+    m_sampleSize = width * 10;
+}
+
+size_t FrequencySketch::index(uint64_t hash, int row) const
+{
+    // 每一行使用不同的种子重新混合哈希值
+    static constexpr uint64_t seeds[DEPTH] = {0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL};
+    uint64_t h = (hash + seeds[row]) * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 32;
+    return row * (m_mask + 1) + (h & m_mask);
+}
+
+void FrequencySketch::increment(uint64_t hash)
+{
+    bool added = false;
+    for (int row = 0; row < DEPTH; row++)
+    {
+        auto &counter = m_table[index(hash, row)];
+        if (counter < 15)
+        {
+            counter++;
+            added = true;
+        }
+    }
+    if (added && ++m_additions >= m_sampleSize)
+    {
+        reset();
+    }
+}
+
+int FrequencySketch::frequency(uint64_t hash) const
+{
+    int freq = 15;
+    for (int row = 0; row < DEPTH; row++)
+    {
+        freq = std::min<int>(freq, m_table[index(hash, row)]);
+    }
+    return freq;
+}
+
+void FrequencySketch::reset()
+{
+    for (auto &counter : m_table)
+    {
+        counter >>= 1;
+    }
+    m_additions /= 2;
+}
+
+std::unique_ptr<CachePolicy> CachePolicy::create(const std::string &name, size_t capacity)
+{
+    if (name == "lru")
+        return std::make_unique<LRUPolicy>();
+    if (name == "tinylfu")
+        return std::make_unique<TinyLFUPolicy>(capacity);
+    if (name == "s3fifo")
+        return std::make_unique<S3FIFOPolicy>();
+    return nullptr;
+}
+
+void LRUPolicy::onHit(CacheNode *node)
+{
+    m_list.remove(node);
+    m_list.pushFront(node);
+}
+
+void LRUPolicy::onInsert(CacheNode *node)
+{
+    m_list.pushFront(node);
+}
+
+void LRUPolicy::onRemove(CacheNode *node)
+{
+    m_list.remove(node);
+}
+
+CacheNode *LRUPolicy::victim()
+{
+    return m_list.back();
+}
+
+TinyLFUPolicy::TinyLFUPolicy(size_t capacity) : m_sketch(capacity)
+{
+}
+
+CacheNodeList &TinyLFUPolicy::list(uint8_t queue)
+{
+    switch (queue)
+    {
+    case WINDOW:
+        return m_window;
+    case PROBATION:
+        return m_probation;
+    default:
+        return m_protected;
+    }
+}
+
+void TinyLFUPolicy::onHit(CacheNode *node)
+{
+    m_sketch.increment(node->hash);
+    list(node->queue).remove(node);
+    if (node->queue == PROBATION)
+    {
+        // 在观察段中再次被访问，晋升到保护段
+        node->queue = PROTECTED;
+        node->freq = 0;
+    }
+    list(node->queue).pushFront(node);
+    // 保护段超出主缓存的80%时，把其中最旧的节点降回观察段
+    size_t protected_max = std::max<size_t>(1, (m_probation.size() + m_protected.size()) * 4 / 5);
+    while (m_protected.size() > protected_max)
+    {
+        auto demoted = m_protected.back();
+        m_protected.remove(demoted);
+        demoted->queue = PROBATION;
+        m_probation.pushFront(demoted);
+    }
+}
+
+void TinyLFUPolicy::onMiss(uint64_t hash)
+{
+    m_sketch.increment(hash);
+}
+
+void TinyLFUPolicy::onInsert(CacheNode *node)
+{
+    node->queue = WINDOW;
+    node->freq = 0;
+    m_window.pushFront(node);
+}
+
+void TinyLFUPolicy::onRemove(CacheNode *node)
+{
+    list(node->queue).remove(node);
+}
+
+CacheNode *TinyLFUPolicy::victim()
+{
+    size_t total = m_window.size() + m_probation.size() + m_protected.size();
+    if (total == 0)
+        return nullptr;
+    // 超出窗口的节点移入观察段的头部，作为等待接纳的候选者（freq标记为1）
+    size_t window_max = std::max<size_t>(1, total / 100);
+    while (m_window.size() > window_max)
+    {
+        auto node = m_window.back();
+        m_window.remove(node);
+        node->queue = PROBATION;
+        node->freq = 1;
+        m_probation.pushFront(node);
+    }
+    CacheNode *victim = m_probation.size() ? m_probation.back() : m_protected.size() ? m_protected.back() : m_window.back();
+    CacheNode *candidate = m_probation.size() ? m_probation.front() : nullptr;
+    if (!candidate || candidate == victim || candidate->freq == 0)
+        return victim;
+    // 最新的候选者与主缓存中最旧的节点竞争，访问频率更高的留下
+    if (m_sketch.frequency(candidate->hash) > m_sketch.frequency(victim->hash))
+    {
+        candidate->freq = 0;
+        return victim;
+    }
+    return candidate;
+}
+
+void S3FIFOPolicy::onHit(CacheNode *node)
+{
+    // 命中时只增加计数，不移动节点
+    node->freq = std::min<uint8_t>(node->freq + 1, MAX_FREQ);
+}
+
+void S3FIFOPolicy::onInsert(CacheNode *node)
+{
+    node->freq = 0;
+    auto it = m_ghost.find(node->hash);
+    if (it != m_ghost.end())
+    {
+        // 最近被淘汰过，说明不是一次性的访问，直接进入主队列
+        m_ghost.erase(it);
+        node->queue = MAIN;
+        m_main.pushFront(node);
+    }
+    else
+    {
+        node->queue = SMALL;
+        m_small.pushFront(node);
+    }
+}
+
+void S3FIFOPolicy::onRemove(CacheNode *node)
+{
+    if (node->queue == SMALL)
+        m_small.remove(node);
+    else
+        m_main.remove(node);
+}
+
+CacheNode *S3FIFOPolicy::victim()
+{
+    for (;;)
+    {
+        size_t total = m_small.size() + m_main.size();
+        if (total == 0)
+            return nullptr;
+        if (m_small.size() && (m_small.size() * 10 >= total || !m_main.size()))
+        {
+            CacheNode *tail = m_small.back();
+            if (tail->freq > 0)
+            {
+                // 在小队列中被再次访问过，移入主队列
+                m_small.remove(tail);
+                tail->queue = MAIN;
+                tail->freq = 0;
+                m_main.pushFront(tail);
+                continue;
+            }
+            addGhost(tail->hash);
+            return tail;
+        }
+        CacheNode *tail = m_main.back();
+        if (tail->freq > 0)
+        {
+            // 被访问过的节点重新放回队首，计数减一
+            tail->freq--;
+            m_main.remove(tail);
+            m_main.pushFront(tail);
+            continue;
+        }
+        return tail;
+    }
+}
+
+void S3FIFOPolicy::addGhost(uint64_t hash)
+{
+    uint64_t generation = ++m_ghostGeneration;
+    m_ghost[hash] = generation;
+    m_ghostOrder.emplace_back(hash, generation);
+    auto expired = [this](const std::pair<uint64_t, uint64_t> &record) {
+        auto it = m_ghost.find(record.first);
+        return it == m_ghost.end() || it->second != record.second;
+    };
+    size_t capacity = std::max<size_t>(m_main.size(), 1);
+    while (!m_ghostOrder.empty() && (m_ghost.size() > capacity || expired(m_ghostOrder.front())))
+    {
+        // 只有代数一致的记录代表幽灵本身，旧的记录出队时不能删除之后重新进入幽灵队列的key
+        if (!expired(m_ghostOrder.front()))
+            m_ghost.erase(m_ghostOrder.front().first);
+        m_ghostOrder.pop_front();
+    }
+    // 队列中间的旧记录过多时整理一次，队列长度不超过容量的两倍，均摊每次O(1)
+    if (m_ghostOrder.size() > capacity * 2)
+    {
+        std::erase_if(m_ghostOrder, expired);
+    }
+}
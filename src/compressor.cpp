@@ -0,0 +1,100 @@
+#include "compressor.h"
+
+#include <algorithm>
+#include <climits>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace
+{
+#ifdef HAVE_ZLIB
+    std::optional<std::string> gzip(const void *data, size_t size)
+    {
+        // zlib的长度为uInt，更大的数据分段输入
+        z_stream stream = {};
+        // windowBits加16生成gzip格式而不是zlib格式
+        if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+            return std::nullopt;
+        std::string out;
+        auto in = static_cast<const unsigned char *>(data);
+        size_t remain = size;
+        char buf[65536];
+        int ret = Z_OK;
+        while (ret != Z_STREAM_END)
+        {
+            if (stream.avail_in == 0 && remain > 0)
+            {
+                stream.next_in = const_cast<unsigned char *>(in);
+                stream.avail_in = static_cast<uInt>(std::min<size_t>(remain, UINT_MAX));
+                in += stream.avail_in;
+                remain -= stream.avail_in;
+            }
+            stream.next_out = reinterpret_cast<unsigned char *>(buf);
+            stream.avail_out = sizeof(buf);
+            ret = deflate(&stream, remain == 0 ? Z_FINISH : Z_NO_FLUSH);
+            if (ret == Z_STREAM_ERROR)
+            {
+                deflateEnd(&stream);
+                return std::nullopt;
+            }
+            out.append(buf, sizeof(buf) - stream.avail_out);
+        }
+        deflateEnd(&stream);
+        return out;
+    }
+#endif
+
+#ifdef HAVE_ZSTD
+    std::optional<std::string> zstd(const void *data, size_t size)
+    {
+        std::string out(ZSTD_compressBound(size), '\0');
+        size_t len = ZSTD_compress(out.data(), out.size(), data, size, 19);
+        if (ZSTD_isError(len))
+            return std::nullopt;
+        out.resize(len);
+        return out;
+    }
+#endif
+}
+
+namespace Compressor
+{
+    bool isSupported(HTTPHeaderParser::Encoding encoding)
+    {
+        switch (encoding)
+        {
+#ifdef HAVE_ZLIB
+        case HTTPHeaderParser::Encoding::GZIP:
+            return true;
+#endif
+#ifdef HAVE_ZSTD
+        case HTTPHeaderParser::Encoding::ZSTD:
+            return true;
+#endif
+        default:
+            return false;
+        }
+    }
+
+    std::optional<std::string> compress(HTTPHeaderParser::Encoding encoding, const void *data, size_t size)
+    {
+        switch (encoding)
+        {
+#ifdef HAVE_ZLIB
+        case HTTPHeaderParser::Encoding::GZIP:
+            return gzip(data, size);
+#endif
+#ifdef HAVE_ZSTD
+        case HTTPHeaderParser::Encoding::ZSTD:
+            return zstd(data, size);
+#endif
+        default:
+            return std::nullopt;
+        }
+    }
+}
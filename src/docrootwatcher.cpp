@@ -0,0 +1,176 @@
+#include "docrootwatcher.h"
+
+DocRootWatcher::DocRootWatcher(std::shared_ptr<FileCachePool> pool, const std::filesystem::path &root)
+    : m_pool(pool), m_root(root.lexically_normal())
+{
+}
+
+DocRootWatcher::~DocRootWatcher()
+{
+    stop();
+}
+
+bool DocRootWatcher::start(std::string &reason)
+{
+    if (m_watching)
+        return true;
+    std::error_code ec;
+    if (!std::filesystem::is_directory(m_root, ec))
+    {
+        reason = m_root.string() + " is not a directory";
+        return false;
+    }
+    m_inotifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyfd < 0)
+    {
+        reason = std::string("inotify_init1: ") + strerror(errno);
+        return false;
+    }
+    if (!addWatchRecursive(m_root, reason))
+    {
+        ::close(m_inotifyfd);
+        m_inotifyfd = -1;
+        m_dirs.clear();
+        return false;
+    }
+    m_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    m_watching = true;
+    m_thread = std::thread(&DocRootWatcher::loop, this);
+    return true;
+}
+
+void DocRootWatcher::stop()
+{
+    if (m_thread.joinable())
+    {
+        eventfd_write(m_wakefd, 1);
+        m_thread.join();
+    }
+    if (m_inotifyfd >= 0)
+    {
+        ::close(m_inotifyfd);
+        m_inotifyfd = -1;
+    }
+    if (m_wakefd >= 0)
+    {
+        ::close(m_wakefd);
+        m_wakefd = -1;
+    }
+    m_dirs.clear();
+    m_watching = false;
+}
+
+void DocRootWatcher::setFallback(std::function<void(const std::string &reason)> fallback)
+{
+    m_fallback = std::move(fallback);
+}
+
+bool DocRootWatcher::isWatching() const
+{
+    return m_watching;
+}
+
+bool DocRootWatcher::addWatchRecursive(const std::filesystem::path &dir, std::string &reason)
+{
+    std::error_code ec;
+    std::vector<std::filesystem::path> dirs = {dir};
+    for (std::filesystem::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+    {
+        if (it->is_directory(ec))
+            dirs.push_back(it->path());
+    }
+    for (auto &curr : dirs)
+    {
+        int wd = inotify_add_watch(m_inotifyfd, curr.c_str(), WATCH_MASK);
+        if (wd < 0)
+        {
+            // ENOSPC代表达到了fs.inotify.max_user_watches的限制；目录在遍历之后被删除则直接忽略
+            if (errno == ENOENT || errno == ENOTDIR)
+                continue;
+            reason = "inotify_add_watch " + curr.string() + ": " + strerror(errno);
+            return false;
+        }
+        // 目录被移动时会保留原来的监视描述符，这里更新为新的路径
+        m_dirs[wd] = curr.lexically_normal().string();
+    }
+    return true;
+}
+
+void DocRootWatcher::loop()
+{
+    alignas(inotify_event) char buf[16 * 1024];
+    pollfd fds[2] = {{m_inotifyfd, POLLIN, 0}, {m_wakefd, POLLIN, 0}};
+    while (m_watching)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents & POLLIN)
+            break;
+        for (;;)
+        {
+            ssize_t len = ::read(m_inotifyfd, buf, sizeof(buf));
+            if (len <= 0)
+                break;
+            for (char *ptr = buf; ptr < buf + len;)
+            {
+                auto event = reinterpret_cast<const inotify_event *>(ptr);
+                handleEvent(event);
+                ptr += sizeof(inotify_event) + event->len;
+            }
+        }
+    }
+}
+
+void DocRootWatcher::handleEvent(const inotify_event *event)
+{
+    if (event->mask & IN_Q_OVERFLOW)
+    {
+        // 丢失了事件，缓存中可能有没有被发现的过期文件
+        fallback("inotify event queue overflow");
+        return;
+    }
+    auto it = m_dirs.find(event->wd);
+    if (it == m_dirs.end())
+        return;
+    if (event->mask & IN_IGNORED)
+    {
+        // 目录被删除，监视已经被内核移除
+        m_dirs.erase(it);
+        return;
+    }
+    if (!event->len)
+        return;
+    // 与HTTPClientTask生成的路径格式保持一致
+    std::string path = (std::filesystem::path(it->second) / event->name).lexically_normal().string();
+    if (event->mask & IN_ISDIR)
+    {
+        if (event->mask & (IN_MOVED_FROM | IN_DELETE))
+        {
+            m_pool->invalidatePrefix(path + "/");
+        }
+        else if (event->mask & (IN_CREATE | IN_MOVED_TO))
+        {
+            // 新的目录（或者移动进来的目录树）需要加入监视，之前同名目录下的缓存项也需要失效
+            m_pool->invalidatePrefix(path + "/");
+            std::string reason;
+            if (!addWatchRecursive(path, reason))
+            {
+                fallback(reason);
+            }
+        }
+        return;
+    }
+    m_pool->invalidate(path);
+}
+
+void DocRootWatcher::fallback(const std::string &reason)
+{
+    if (!m_watching.exchange(false))
+        return;
+    if (m_fallback)
+        m_fallback(reason);
+}
@@ -1,82 +1,512 @@
 #include "filecachepool.h"
+#include "compressor.h"
 
-FileCachePool::FileCachePool(off_t max_size, int max_item)
+#include <algorithm>
+
+FileCachePool::FileCachePool(off_t max_size, int max_item, int shards, const std::string &policy, size_t small_file, off_t sendfile_min, off_t stream_min)
+    : m_sendfileMin(std::max(sendfile_min, static_cast<off_t>(0))), m_shards(std::max(shards, 1))
 {
+    if (small_file > 0)
+    {
+        m_arena = std::make_shared<SlabArena>(small_file);
+    }
     m_maxItem = std::max(max_item, 0);
     m_maxSize = std::max(max_size, static_cast<off_t>(0));
+    // 超出整个缓存容量的文件即使加载了也会立即被淘汰，直接流式发送
+    m_streamMin = stream_min > 0 ? std::min(stream_min, m_maxSize + 1) : m_maxSize + 1;
     m_currSize = 0;
+    m_currItem = 0;
+    m_revalidateInterval = 0;
+    m_trust = false;
+    m_hashETag = false;
+    m_precompressed = false;
+    for (auto &compress : m_compress)
+    {
+        compress = false;
+    }
+    m_compressMin = 0;
+    m_compressMax = 0;
+    // 每个分片的策略按照平均分到的缓存项数量初始化
+    size_t capacity = std::max<size_t>(m_maxItem / m_shards.size(), 1);
+    for (auto &shard : m_shards)
+    {
+        shard.policy = CachePolicy::create(policy, capacity);
+        if (!shard.policy)
+        {
+            shard.policy = CachePolicy::create("lru", capacity);
+        }
+    }
 }
 
 FileCachePool::~FileCachePool()
 {
-    
+    {
+        std::scoped_lock locker(m_jobLock);
+        m_stopping = true;
+    }
+    m_jobCond.notify_all();
+    if (m_compressor.joinable())
+    {
+        m_compressor.join();
+    }
 }
 
 std::shared_ptr<FileCacheItem> FileCachePool::getFile(const std::string &path)
 {
-    std::scoped_lock locker(m_lock);
-    auto it = m_cacheMap.find(path);
-    if (it != m_cacheMap.end())
+    uint64_t hash = KeyHash{}(path);
+    auto &shard = m_shards[hash % m_shards.size()];
+    std::unique_lock locker(shard.lock);
+    if (auto item = lookup(shard, locker, path))
+    {
+        return item;
+    }
+    // 在缓存中没有找到文件
+    auto loading = shard.loading.find(path);
+    if (loading != shard.loading.end())
+    {
+        // 其他线程正在加载同一个文件，等待它的结果
+        auto result = loading->second.result;
+        locker.unlock();
+        return result.get();
+    }
+    shard.policy->onMiss(hash);
+    // 登记正在加载，然后在锁外创建新的缓存项（stat、open和mmap可能很慢，不能阻塞同一分片中的其他请求）
+    std::promise<std::shared_ptr<FileCacheItem>> promise;
+    shard.loading[path].result = promise.get_future().share();
+    locker.unlock();
+    std::shared_ptr<FileCacheItem> newFileCache;
+    try
+    {
+        newFileCache = std::make_shared<FileCacheItem>(path, m_arena, m_sendfileMin, m_streamMin, m_hashETag.load());
+    }
+    catch (...)
+    {
+        locker.lock();
+        shard.loading.erase(path);
+        locker.unlock();
+        promise.set_exception(std::current_exception());
+        throw;
+    }
+    if (!newFileCache->isLoaded())
+    {
+        // 文件读取失败，返回一个空指针
+        newFileCache.reset();
+    }
+    else
+    {
+        if (m_precompressed && !newFileCache->isStreaming())
+        {
+            loadVariants(path, *newFileCache);
+        }
+        setResponseHeaders(path, *newFileCache);
+    }
+    locker.lock();
+    auto flight = shard.loading.find(path);
+    bool cancelled = flight->second.cancelled;
+    shard.loading.erase(flight);
+    // 流式发送的文件不进入缓存，不会挤掉其他的缓存项
+    if (newFileCache && !cancelled && !newFileCache->isStreaming())
+    {
+        insert(shard, path, hash, newFileCache);
+    }
+    locker.unlock();
+    promise.set_value(newFileCache);
+    return newFileCache;
+}
+
+std::shared_ptr<FileCacheItem> FileCachePool::peekFile(const std::string &path)
+{
+    auto &shard = m_shards[KeyHash{}(path) % m_shards.size()];
+    std::scoped_lock locker(shard.lock);
+    // 未缓存或者需要重新验证时返回空指针，stat和重新加载都由getFile在线程池中完成
+    auto it = shard.cacheMap.find(path);
+    if (it == shard.cacheMap.end() || !isFresh(it->second))
+        return std::shared_ptr<FileCacheItem>();
+    shard.policy->onHit(&it->second);
+    return it->second.item;
+}
+
+void FileCachePool::invalidate(const std::string &path)
+{
+    invalidateOne(path);
+    // 压缩副本在读取时会按照ETag检查版本，这里只是尽早释放内存
+    for (size_t i = 0; i < HTTPHeaderParser::ENCODING_COUNT; i++)
+    {
+        invalidateOne(compressedKey(path, static_cast<HTTPHeaderParser::Encoding>(i)));
+    }
+    // 预压缩文件与原文件缓存在一起，它的变化使原文件失效
+    for (size_t i = 0; i < HTTPHeaderParser::ENCODING_COUNT; i++)
+    {
+        std::string_view extension = HTTPHeaderParser::encodingExtension(static_cast<HTTPHeaderParser::Encoding>(i));
+        if (path.ends_with(extension))
+        {
+            invalidateOne(path.substr(0, path.size() - extension.size()));
+        }
+    }
+}
+
+void FileCachePool::invalidateOne(const std::string &path)
+{
+    auto &shard = m_shards[KeyHash{}(path) % m_shards.size()];
+    std::scoped_lock locker(shard.lock);
+    auto it = shard.cacheMap.find(path);
+    if (it != shard.cacheMap.end())
+    {
+        erase(shard, it);
+    }
+    // 正在加载的文件可能读到了修改之前的内容
+    auto loading = shard.loading.find(path);
+    if (loading != shard.loading.end())
+    {
+        loading->second.cancelled = true;
+    }
+}
+
+void FileCachePool::invalidatePrefix(const std::string &prefix)
+{
+    for (auto &shard : m_shards)
     {
-        // 在缓存中找到了文件
-        // 更新order
-        // 检查文件的更新时间和大小与缓存中的是否一致，如果不一致，则删除旧文件
-        m_cacheOrder.remove(path);
-        if (fileConsistencyCheck(path, *m_cacheMap[path]->getStat()))
+        std::scoped_lock locker(shard.lock);
+        for (auto it = shard.cacheMap.begin(); it != shard.cacheMap.end();)
+        {
+            auto curr = it++;
+            if (curr->first.starts_with(prefix))
+            {
+                erase(shard, curr);
+            }
+        }
+        for (auto &[path, loading] : shard.loading)
         {
-            // 通过了一致性检查
-            m_cacheOrder.push_front(path);
-            return it->second;
+            if (path.starts_with(prefix))
+            {
+                loading.cancelled = true;
+            }
+        }
+    }
+}
+
+off_t FileCachePool::getCurrentSize()
+{
+    return m_currSize;
+}
+
+int FileCachePool::getCurrentItemCount()
+{
+    return m_currItem;
+}
+
+void FileCachePool::setRevalidateInterval(std::chrono::milliseconds interval)
+{
+    m_revalidateInterval = std::max<std::chrono::milliseconds::rep>(interval.count(), 0);
+}
+
+void FileCachePool::setTrustCache(bool trust)
+{
+    m_trust = trust;
+}
+
+void FileCachePool::setHashETag(bool hash)
+{
+    m_hashETag = hash;
+}
+
+void FileCachePool::setPrecompressed(bool precompressed)
+{
+    m_precompressed = precompressed;
+}
+
+void FileCachePool::setMimeTypes(MimeTypes mime_types)
+{
+    m_mimeTypes = std::move(mime_types);
+}
+
+void FileCachePool::loadVariants(const std::string &path, FileCacheItem &item)
+{
+    for (size_t i = 0; i < HTTPHeaderParser::ENCODING_COUNT; i++)
+    {
+        auto encoding = static_cast<HTTPHeaderParser::Encoding>(i);
+        std::string sibling = path + HTTPHeaderParser::encodingExtension(encoding);
+        auto variant = std::make_shared<FileCacheItem>(sibling, m_arena, m_sendfileMin, 0, m_hashETag.load());
+        // 记录预压缩文件当时的状态，重新验证时发现它被修改、删除或者新生成都会使缓存项失效
+        if (variant->isLoaded())
+        {
+            item.setSiblingStat(encoding, variant->getStat());
         }
         else
         {
-            m_cacheMap.erase(path);
+            struct stat fstat;
+            item.setSiblingStat(encoding, ::stat(sibling.c_str(), &fstat) == 0 ? &fstat : nullptr);
+        }
+        // 比原文件旧的预压缩文件可能是修改原文件之前生成的，不能使用
+        if (variant->isLoaded() && !(variant->getStat()->st_mtim.tv_sec < item.getStat()->st_mtim.tv_sec))
+        {
+            item.setVariant(encoding, variant);
         }
+    }
+}
 
+void FileCachePool::setCompression(const std::vector<HTTPHeaderParser::Encoding> &encodings, off_t min_size, off_t max_size)
+{
+    bool enabled = false;
+    for (size_t i = 0; i < HTTPHeaderParser::ENCODING_COUNT; i++)
+    {
+        auto encoding = static_cast<HTTPHeaderParser::Encoding>(i);
+        m_compress[i] = Compressor::isSupported(encoding) && std::find(encodings.begin(), encodings.end(), encoding) != encodings.end();
+        enabled = enabled || m_compress[i];
     }
-    // 在缓存中没有找到文件
-    // 创建新的缓存项
-    auto newFileCache = std::make_shared<FileCacheItem>(path);
-    if (!newFileCache->getData())
+    m_compressMin = std::max(min_size, static_cast<off_t>(1));
+    m_compressMax = max_size;
+    std::scoped_lock locker(m_jobLock);
+    if (enabled && !m_compressor.joinable())
     {
-        // 文件读取失败，返回一个空指针
+        m_compressor = std::thread(&FileCachePool::compressLoop, this);
+    }
+}
+
+bool FileCachePool::isCompressible(const FileCacheItem &item) const
+{
+    if (item.isStreaming() || item.getStat()->st_size < m_compressMin || item.getStat()->st_size > m_compressMax)
+        return false;
+    for (auto &compress : m_compress)
+    {
+        if (compress)
+            return true;
+    }
+    return false;
+}
+
+std::shared_ptr<FileCacheItem> FileCachePool::getCompressed(const std::shared_ptr<FileCacheItem> &item, HTTPHeaderParser::Encoding encoding)
+{
+    if (!m_compress[static_cast<size_t>(encoding)] || !isCompressible(*item))
         return std::shared_ptr<FileCacheItem>();
+    // 按照组成部分查找压缩副本，命中时不需要拼接key
+    CompressedKey key{item->getPath(), encoding};
+    uint64_t hash = KeyHash{}(key);
+    auto &shard = m_shards[hash % m_shards.size()];
+    {
+        std::scoped_lock locker(shard.lock);
+        auto it = shard.cacheMap.find(key);
+        if (it != shard.cacheMap.end())
+        {
+            auto &compressed = it->second.item;
+            if (compressed->getSourceETag() == item->getETag())
+            {
+                shard.policy->onHit(&it->second);
+                // 压缩没有效果时缓存的是一个空的占位项，直接发送原文件
+                return compressed->isLoaded() ? compressed : std::shared_ptr<FileCacheItem>();
+            }
+            // 文件已经被修改，压缩副本属于旧的版本
+            erase(shard, it);
+        }
+        shard.policy->onMiss(hash);
+    }
+    // 在压缩完成之前发送原文件
+    std::unique_lock locker(m_jobLock);
+    if (m_jobs.size() < MAX_COMPRESS_JOBS && !m_queued.contains(key))
+    {
+        auto &job = m_jobs.emplace_back(CompressJob{compressedKey(item->getPath(), encoding), item, encoding});
+        m_queued.insert(job.key);
+        locker.unlock();
+        m_jobCond.notify_one();
+    }
+    return std::shared_ptr<FileCacheItem>();
+}
+
+std::string FileCachePool::compressedKey(const std::string &path, HTTPHeaderParser::Encoding encoding)
+{
+    // 文件路径中不会出现'\0'
+    return path + '\0' + HTTPHeaderParser::encoding2str(encoding);
+}
+
+size_t FileCachePool::KeyHash::operator()(std::string_view key) const
+{
+    // 压缩副本的key在'\0'之后是编码名称，与CompressedKey的哈希保持一致
+    auto separator = key.find('\0');
+    if (separator == std::string_view::npos)
+        return std::hash<std::string_view>{}(key);
+    return combine(std::hash<std::string_view>{}(key.substr(0, separator)), key.substr(separator + 1));
+}
+
+size_t FileCachePool::KeyHash::operator()(const CompressedKey &key) const
+{
+    return combine(std::hash<std::string_view>{}(key.path), HTTPHeaderParser::encoding2str(key.encoding));
+}
+
+size_t FileCachePool::KeyHash::combine(size_t path_hash, std::string_view encoding)
+{
+    return path_hash ^ (std::hash<std::string_view>{}(encoding) + 0x9e3779b97f4a7c15ull + (path_hash << 6) + (path_hash >> 2));
+}
+
+bool FileCachePool::KeyEqual::operator()(const CompressedKey &a, std::string_view b) const
+{
+    std::string_view encoding = HTTPHeaderParser::encoding2str(a.encoding);
+    return b.size() == a.path.size() + 1 + encoding.size() && b.starts_with(a.path) && b[a.path.size()] == '\0' && b.ends_with(encoding);
+}
+
+void FileCachePool::compressLoop()
+{
+    std::unique_lock locker(m_jobLock);
+    for (;;)
+    {
+        m_jobCond.wait(locker, [this] { return m_stopping || !m_jobs.empty(); });
+        if (m_stopping)
+            return;
+        auto job = std::move(m_jobs.front());
+        m_jobs.pop_front();
+        locker.unlock();
+        compress(job);
+        locker.lock();
+        // 压缩副本已经进入缓存之后才允许再次排队
+        m_queued.erase(job.key);
+    }
+}
+
+void FileCachePool::compress(const CompressJob &job)
+{
+    auto &source = *job.source;
+    off_t size = source.getStat()->st_size;
+    const void *data = source.getData();
+    std::string content;
+    if (data == nullptr)
+    {
+        // 使用sendfile的文件没有映射到内存中，读取一次
+        content.resize(size);
+        off_t offset = 0;
+        while (offset < size)
+        {
+            ssize_t len = ::pread(source.getFd(), content.data() + offset, size - offset, offset);
+            if (len < 0 && errno == EINTR)
+                continue;
+            if (len <= 0)
+                return;
+            offset += len;
+        }
+        data = content.data();
+    }
+    auto result = Compressor::compress(job.encoding, data, size);
+    if (!result || static_cast<off_t>(result->size()) >= size)
+    {
+        // 压缩失败或者没有变小，缓存一个占位项，避免每次请求都重新压缩
+        result = std::string();
+    }
+    auto compressed = std::make_shared<FileCacheItem>(source, job.encoding, std::move(*result), m_arena);
+    compressed->setResponseHeaders(source.getContentType(), HTTPHeaderParser::encoding2str(job.encoding), true);
+    uint64_t hash = KeyHash{}(job.key);
+    auto &shard = m_shards[hash % m_shards.size()];
+    std::scoped_lock locker(shard.lock);
+    insert(shard, job.key, hash, compressed);
+}
+
+void FileCachePool::insert(Shard &shard, const std::string &key, uint64_t hash, std::shared_ptr<FileCacheItem> item)
+{
+    auto it = shard.cacheMap.find(key);
+    if (it != shard.cacheMap.end())
+    {
+        erase(shard, it);
     }
     // 添加到map和order
-    m_cacheMap[path] = newFileCache;
-    m_cacheOrder.push_front(path);
+    it = shard.cacheMap.try_emplace(key).first;
+    auto &entry = it->second;
+    entry.key = &it->first;
+    entry.item = item;
+    entry.hash = hash;
+    entry.validated = std::chrono::steady_clock::now();
+    shard.policy->onInsert(&entry);
     // 更新大小
-    m_currSize += newFileCache->getStat()->st_size;
+    m_currSize += item->getResidentSize();
+    m_currItem++;
     // 清除多余的缓存项
-    evict();
-    return newFileCache;
+    evict(shard, &entry);
 }
 
-off_t FileCachePool::getCurrentSize()
+void FileCachePool::setResponseHeaders(const std::string &path, FileCacheItem &item)
 {
-    return m_currSize;
+    // 根据文件的后缀名生成MIME格式，预压缩文件和压缩副本使用原文件的MIME格式
+    auto content_type = m_mimeTypes.lookupPath(path);
+    bool vary = item.hasVariants() || (HTTPHeaderParser::isCompressibleType(content_type) && isCompressible(item));
+    item.setResponseHeaders(content_type, nullptr, vary);
+    for (size_t i = 0; i < HTTPHeaderParser::ENCODING_COUNT; i++)
+    {
+        auto encoding = static_cast<HTTPHeaderParser::Encoding>(i);
+        if (auto variant = item.getVariant(encoding))
+        {
+            variant->setResponseHeaders(content_type, HTTPHeaderParser::encoding2str(encoding), true);
+        }
+    }
 }
 
-int FileCachePool::getCurrentItemCount()
+void FileCachePool::evict(Shard &shard, Entry *inserted)
 {
-    return m_cacheOrder.size();
+    // 只在当前分片中淘汰，其他分片超出的部分由它们自己在下一次插入时淘汰
+    while ((m_currSize > m_maxSize || m_currItem > m_maxItem) && shard.cacheMap.size() > 1)
+    {
+        auto victim = static_cast<Entry *>(shard.policy->victim());
+        bool rejected = victim == inserted;
+        erase(shard, shard.cacheMap.find(*victim->key));
+        // 策略拒绝接纳新的文件，分片恢复到插入之前的状态
+        if (rejected)
+            return;
+    }
+    // 刚刚插入的文件本身就超出了限制
+    if (inserted->item->getResidentSize() > m_maxSize || m_maxItem == 0)
+    {
+        erase(shard, shard.cacheMap.find(*inserted->key));
+    }
 }
 
-void FileCachePool::evict()
+void FileCachePool::erase(Shard &shard, CacheMap::iterator it)
 {
-    while (m_currSize > m_maxSize || m_cacheMap.size() > m_maxItem)
+    m_currSize -= it->second.item->getResidentSize();
+    m_currItem--;
+    shard.policy->onRemove(&it->second);
+    shard.cacheMap.erase(it);
+}
+
+std::shared_ptr<FileCacheItem> FileCachePool::lookup(Shard &shard, std::unique_lock<std::mutex> &locker, const std::string &path)
+{
+    auto it = shard.cacheMap.find(path);
+    if (it == shard.cacheMap.end())
+        return std::shared_ptr<FileCacheItem>();
+    if (isFresh(it->second))
     {
-        auto& curr_rm_path = m_cacheOrder.back();
-        auto curr_rm_size = m_cacheMap[curr_rm_path]->getStat()->st_size;
-        m_cacheMap.erase(curr_rm_path);
-        m_cacheOrder.pop_back();
-        m_currSize -= curr_rm_size;
+        shard.policy->onHit(&it->second);
+        return it->second.item;
     }
+    // 检查文件的更新时间和大小与缓存中的是否一致，stat在锁外进行
+    auto item = it->second.item;
+    locker.unlock();
+    bool valid = fileConsistencyCheck(path, *item->getStat()) && siblingConsistencyCheck(path, *item);
+    auto now = std::chrono::steady_clock::now();
+    locker.lock();
+    // 解锁期间缓存项可能已经被淘汰或者替换
+    it = shard.cacheMap.find(path);
+    if (it == shard.cacheMap.end() || it->second.item != item)
+    {
+        return valid ? item : std::shared_ptr<FileCacheItem>();
+    }
+    if (!valid)
+    {
+        // 不一致，删除旧文件
+        erase(shard, it);
+        return std::shared_ptr<FileCacheItem>();
+    }
+    // 通过了一致性检查，更新order
+    it->second.validated = now;
+    shard.policy->onHit(&it->second);
+    return item;
+}
+
+bool FileCachePool::isFresh(const Entry &entry)
+{
+    if (m_trust)
+        return true;
+    // 在间隔之内验证过的缓存项直接使用，不需要stat
+    return std::chrono::steady_clock::now() - entry.validated < std::chrono::milliseconds(m_revalidateInterval.load());
 }
 
 bool FileCachePool::compareTimeSpec(const timespec &t1, const timespec &t2)
 {
-    return t1.tv_nsec == t2.tv_nsec;
+    return t1.tv_sec == t2.tv_sec && t1.tv_nsec == t2.tv_nsec;
 }
 
 bool FileCachePool::fileConsistencyCheck(const std::string &path, const struct stat& old_fstat)
@@ -85,10 +515,37 @@ bool FileCachePool::fileConsistencyCheck(const std::string &path, const struct s
     if (::stat(path.c_str(), &fstat) < 0)
         return false;
 
-    if (!compareTimeSpec(fstat.st_mtim, old_fstat.st_mtim) || !compareTimeSpec(fstat.st_atim, old_fstat.st_atim) || !compareTimeSpec(fstat.st_ctim, old_fstat.st_ctim) || fstat.st_size != old_fstat.st_size)
+    // 不比较atime，读取文件本身就会改变它；inode变化说明文件被替换（例如rename覆盖）
+    if (!compareTimeSpec(fstat.st_mtim, old_fstat.st_mtim) || !compareTimeSpec(fstat.st_ctim, old_fstat.st_ctim) || fstat.st_size != old_fstat.st_size || fstat.st_ino != old_fstat.st_ino || fstat.st_dev != old_fstat.st_dev)
     {
         return false;
     }
 
     return true;
 }
+
+bool FileCachePool::siblingConsistencyCheck(const std::string &path, const FileCacheItem &item)
+{
+    // 没有查找过预压缩文件的缓存项不依赖它们
+    if (!item.siblingsProbed())
+        return true;
+    for (size_t i = 0; i < HTTPHeaderParser::ENCODING_COUNT; i++)
+    {
+        auto encoding = static_cast<HTTPHeaderParser::Encoding>(i);
+        std::string sibling = path + HTTPHeaderParser::encodingExtension(encoding);
+        auto &old_fstat = item.getSiblingStat(encoding);
+        if (old_fstat)
+        {
+            if (!fileConsistencyCheck(sibling, *old_fstat))
+                return false;
+        }
+        else
+        {
+            // 加载时不存在的预压缩文件之后生成了
+            struct stat fstat;
+            if (::stat(sibling.c_str(), &fstat) == 0)
+                return false;
+        }
+    }
+    return true;
+}
@@ -73,7 +73,9 @@ void HashedWheelTimer::delTimer(Timer *t)
 
 void HashedWheelTimer::tick()
 {
+    // 先移动到下一个位置，回调中重新添加的计时器不会被放进正在处理的位置
     TimerContainerNode* curr_node = m_wheel[m_div];
+    m_div = (m_div + 1) % m_wheel.size();
 
     while (curr_node)
     {
@@ -84,11 +86,11 @@ void HashedWheelTimer::tick()
         } 
         else 
         {
-            curr_node->t->callback();
-            delTimer(curr_node->t);
+            // 先删除再调用回调，允许回调重新添加同一个计时器
+            Timer* t = curr_node->t;
+            delTimer(t);
+            t->callback();
         }
         curr_node = next_node;
     }
-    
-    m_div = (m_div + 1) % m_wheel.size();
 }
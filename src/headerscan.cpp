@@ -0,0 +1,145 @@
+#include "headerscan.h"
+
+#include <atomic>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HEADERSCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    using FindFunc = size_t (*)(const char *, size_t, char, char);
+
+    size_t findScalar(const char *data, size_t len, char a, char b)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            if (data[i] == a || data[i] == b)
+                return i;
+        }
+        return len;
+    }
+
+#ifdef HEADERSCAN_X86
+    // 每次比较16个字节，结果的掩码中最低的置位即为第一个匹配的位置；不足一个向量的尾部逐字节比较，不会读到len之外
+    size_t findSSE2(const char *data, size_t len, char a, char b)
+    {
+        const __m128i va = _mm_set1_epi8(a);
+        const __m128i vb = _mm_set1_epi8(b);
+        size_t i = 0;
+        for (; i + 16 <= len; i += 16)
+        {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+            int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, va), _mm_cmpeq_epi8(chunk, vb)));
+            if (mask != 0)
+                return i + __builtin_ctz(mask);
+        }
+        return i + findScalar(data + i, len - i, a, b);
+    }
+
+    __attribute__((target("avx2"))) size_t findAVX2(const char *data, size_t len, char a, char b)
+    {
+        const __m256i va = _mm256_set1_epi8(a);
+        const __m256i vb = _mm256_set1_epi8(b);
+        size_t i = 0;
+        for (; i + 32 <= len; i += 32)
+        {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+            unsigned mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(chunk, va), _mm256_cmpeq_epi8(chunk, vb)));
+            if (mask != 0)
+                return i + __builtin_ctz(mask);
+        }
+        return i + findSSE2(data + i, len - i, a, b);
+    }
+#endif
+
+    FindFunc func(HeaderScan::Impl impl)
+    {
+        switch (impl)
+        {
+#ifdef HEADERSCAN_X86
+        case HeaderScan::Impl::AVX2:
+            return findAVX2;
+        case HeaderScan::Impl::SSE2:
+            return findSSE2;
+#endif
+        default:
+            return findScalar;
+        }
+    }
+
+    HeaderScan::Impl best()
+    {
+        for (auto impl : {HeaderScan::Impl::AVX2, HeaderScan::Impl::SSE2})
+        {
+            if (HeaderScan::isSupported(impl))
+                return impl;
+        }
+        return HeaderScan::Impl::SCALAR;
+    }
+
+    // 常量初始化，其他编译单元的静态初始化中也可以使用；第一次使用时按照CPU选择，之后只是一次间接调用
+    std::atomic<HeaderScan::Impl> s_impl = HeaderScan::Impl::SCALAR;
+    std::atomic<FindFunc> s_find = nullptr;
+
+    FindFunc current()
+    {
+        auto find = s_find.load(std::memory_order_relaxed);
+        if (find == nullptr)
+        {
+            HeaderScan::select(best());
+            find = s_find.load(std::memory_order_relaxed);
+        }
+        return find;
+    }
+}
+
+namespace HeaderScan
+{
+    bool isSupported(Impl impl)
+    {
+#ifdef HEADERSCAN_X86
+        // 可能在libgcc初始化CPU信息之前被调用
+        __builtin_cpu_init();
+#endif
+        switch (impl)
+        {
+        case Impl::SCALAR:
+            return true;
+#ifdef HEADERSCAN_X86
+        case Impl::SSE2:
+            return __builtin_cpu_supports("sse2");
+        case Impl::AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+        }
+    }
+
+    bool select(Impl impl)
+    {
+        if (!isSupported(impl))
+            return false;
+        s_impl = impl;
+        s_find = func(impl);
+        return true;
+    }
+
+    Impl selected()
+    {
+        current();
+        return s_impl;
+    }
+
+    size_t find(const char *data, size_t len, char a, char b)
+    {
+        return current()(data, len, a, b);
+    }
+
+    size_t find(Impl impl, const char *data, size_t len, char a, char b)
+    {
+        return func(impl)(data, len, a, b);
+    }
+}
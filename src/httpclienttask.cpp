@@ -1,11 +1,18 @@
 #include "httpclienttask.h"
 
+#include <random>
+
 std::filesystem::path HTTPClientTask::s_docRoot;
-int HTTPClientTask::s_epfd;
 std::atomic<int> HTTPClientTask::s_userCnt;
 std::shared_ptr<FileCachePool> HTTPClientTask::s_pool;
 std::vector<std::mutex> HTTPClientTask::s_client_lock;
 std::shared_ptr<spdlog::logger> HTTPClientTask::s_logger;
+std::chrono::milliseconds HTTPClientTask::s_idleTimeout(10000);
+std::chrono::milliseconds HTTPClientTask::s_headerTimeout(10000);
+std::chrono::milliseconds HTTPClientTask::s_writeTimeout(10000);
+
+// 过载时使用的响应，预先生成以避免在事件循环中格式化
+static const std::string s_respond503 = "HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\nContent-Length: 23\r\n\r\n503 Service Unavailable";
 
 HTTPClientTask::HTTPClientTask()
 {
@@ -18,7 +25,22 @@ HTTPClientTask::~HTTPClientTask()
 
 void HTTPClientTask::process(TaskContext context)
 {
-    std::scoped_lock locker(s_client_lock[m_sockfd]);
+    process(context, m_generation.load());
+}
+
+void HTTPClientTask::process(TaskContext context, uint32_t generation)
+{
+    // 连接可能已经被关闭（例如超时回调晚于连接的关闭）
+    int sockfd = m_sockfd;
+    if (sockfd < 0)
+        return;
+    std::scoped_lock locker(s_client_lock[sockfd]);
+    // 任务提交之后连接被关闭，fd又被新的连接使用
+    if (generation != m_generation.load())
+    {
+        s_logger->trace("[client] socket {}: drop stale task of generation {}", sockfd, generation);
+        return;
+    }
     switch (context)
     {
     case TaskContext::IN:
@@ -27,6 +49,12 @@ void HTTPClientTask::process(TaskContext context)
         processRead();
     }
     break;
+    case TaskContext::RESPOND:
+    {
+        // 请求头已经在事件循环中解析完成，生成响应
+        respond();
+    }
+    break;
     case TaskContext::OUT:
     {
         // 写入任务
@@ -44,17 +72,31 @@ void HTTPClientTask::process(TaskContext context)
     }
 }
 
-void HTTPClientTask::init(int sockfd, sockaddr_in &addr)
+ThreadPool::Task HTTPClientTask::makeTask(TaskContext context)
+{
+    return ThreadPool::Task{&HTTPClientTask::runTask, this, static_cast<int>(context), m_generation.load()};
+}
+
+void HTTPClientTask::runTask(void *client, int context, uint32_t generation)
+{
+    static_cast<HTTPClientTask *>(client)->process(static_cast<TaskContext>(context), generation);
+}
+
+void HTTPClientTask::init(int sockfd, sockaddr_in &addr, int epfd)
 {
     std::scoped_lock locker(s_client_lock[sockfd]);
     if (m_sockfd > 0)
         close();
+    m_generation.fetch_add(1);
     m_parser.setBuffer(m_readBuf.data());
     Utils::setfdnonblocking(sockfd);
     Utils::setreusefd(sockfd, true);
-    Utils::addepfd(s_epfd, sockfd, EPOLLIN | EPOLLET | EPOLLONESHOT | EPOLLRDHUP);
+    // 注册到epoll之前设置好m_sockfd，事件可能在addepfd返回之前就被其他线程处理
+    m_epfd = epfd;
     m_sockfd = sockfd;
     m_addr = addr;
+    touch(Phase::IDLE);
+    Utils::addepfd(epfd, sockfd, EPOLLIN | EPOLLET | EPOLLONESHOT | EPOLLRDHUP);
     // 用户数量+1
     s_userCnt.fetch_add(1);
     s_logger->info("[client] socket {}: init, current client count: {}", m_sockfd, s_userCnt.load());
@@ -68,166 +110,469 @@ void HTTPClientTask::close()
         return;
     }
     
-    Utils::delepfd(s_epfd, m_sockfd);
+    Utils::delepfd(m_epfd, m_sockfd);
     ::close(m_sockfd);
     // 重置所有变量
     m_readBuf.fill('\0');
     m_readIdx = 0;
-    m_remainBytes = 0;
+    m_parsedIdx = 0;
     m_fcont.reset();
-    m_iv[0].iov_len = 0;
-    m_iv[0].iov_base = nullptr;
-    m_iv[1].iov_len = 0;
-    m_iv[1].iov_base = nullptr;
+    m_responses.clear();
+    m_segments.clear();
+    m_segmentIdx = 0;
     // 用户数量-1
     s_userCnt.fetch_sub(1);
     s_logger->info("[client] socket {}: closed, current client count: {}", m_sockfd, s_userCnt.load());
     m_sockfd = -1;
+    m_epfd = -1;
     // 重置parser
-    m_parser.reset();
+    m_parser.setBuffer(m_readBuf.data());
 }
 
 void HTTPClientTask::processRead()
 {
     // 读取任务：首先读取sockfd上的全部数据，然后格式化请求头，请求头格式化完毕后尝试将目标文件映射到内存中并注册写入事件
+    if (!readRequest())
+        return;
+    respond();
+}
+
+std::optional<HTTPClientTask::TaskContext> HTTPClientTask::processInline(bool overloaded)
+{
+    int sockfd = m_sockfd;
+    if (sockfd < 0)
+        return std::nullopt;
+    // 连接正在被工作线程处理（例如关闭），交给线程池按原来的方式处理
+    std::unique_lock locker(s_client_lock[sockfd], std::try_to_lock);
+    if (!locker.owns_lock())
+        return TaskContext::IN;
+    if (!readRequest())
+        return std::nullopt;
+    do
+    {
+        if (!m_badRequest)
+        {
+            // 只使用缓存中已有并且内容在内存中的文件，需要从磁盘加载、sendfile或者可能产生缺页的文件交给线程池处理，已经生成的响应留在队列中一起发送
+            m_fcont = s_pool->peekFile(m_docPath);
+            if (!m_fcont || !m_fcont->isInMemory())
+            {
+                m_fcont.reset();
+                if (overloaded && !m_responses.empty())
+                {
+                    // 过载时不交给线程池，前面的流水线请求已经生成了响应，在它们之后按顺序返回503并关闭连接
+                    s_logger->warn("[client] socket {}: server overloaded, respond SERVICE_UNAVAILABLE after {} responses", m_sockfd, m_responses.size());
+                    m_keep_connection = false;
+                    m_responses.emplace_back();
+                    m_segments.push_back({s_respond503.data(), 0, static_cast<off_t>(s_respond503.size()), nullptr});
+                    break;
+                }
+                s_logger->trace("[client] socket {}: cache miss or body not in memory, respond in thread pool", m_sockfd);
+                return TaskContext::RESPOND;
+            }
+        }
+        prepareRespond();
+    } while (m_keep_connection && nextRequest());
+    // 直接尝试写入，写入不完整时processWrite会注册EPOLLOUT，后续的写入由线程池完成
+    processWrite();
+    return std::nullopt;
+}
+
+bool HTTPClientTask::reject()
+{
+    int sockfd = m_sockfd;
+    if (sockfd < 0)
+        return true;
+    std::unique_lock locker(s_client_lock[sockfd], std::try_to_lock);
+    if (!locker.owns_lock())
+        return false;
+    // 读出socket上的数据，关闭时接收缓存中残留数据会导致内核发送RST
+    std::array<char, READ_BUFFER_SIZE> discard;
+    while (recv(m_sockfd, discard.data(), discard.size(), 0) > 0)
+    {
+    }
+    send(m_sockfd, s_respond503.data(), s_respond503.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    s_logger->warn("[client] socket {}: server overloaded, respond SERVICE_UNAVAILABLE", m_sockfd);
+    close();
+    return true;
+}
+
+bool HTTPClientTask::readRequest()
+{
     auto read_ret = read();
     // 如果read返回false，则直接关闭连接
     if (!read_ret)
     {
         close();
-        return;
+        return false;
     }
-    auto parse_ret = m_parser.parseRequest(m_readIdx);
+    auto parse_ret = parseRequest();
     switch (parse_ret)
     {
     case HTTPHeaderParser::Status::WORKING:
     {
         // 还有数据没有读入
         s_logger->trace("[client] socket {}: need more data", m_sockfd);
-        Utils::modepfd(s_epfd, m_sockfd, EPOLLIN | EPOLLET | EPOLLONESHOT | EPOLLRDHUP);
+        Utils::modepfd(m_epfd, m_sockfd, EPOLLIN | EPOLLET | EPOLLONESHOT | EPOLLRDHUP);
     }
     break;
     case HTTPHeaderParser::Status::DONE:
     {
-        // 数据已经读取完成
-        s_logger->trace("[client] socket {}: header parse done", m_sockfd);
-        // 重置接收缓存的位置
-        m_readIdx = 0;
-        auto req_header = m_parser.getRequestHeader();
+        return true;
+    }
+    case HTTPHeaderParser::Status::ERROR:
+    {
+        // 出现了错误，关闭连接
+        close();
+        s_logger->warn("[client] socket {}: header parse error, connection closed", m_sockfd);
+    }
+    break;
+    default:
+        // ??
+        break;
+    }
+    return false;
+}
+
+bool HTTPClientTask::nextRequest()
+{
+    // 上一个请求已经生成了响应，从它的结尾开始解析
+    m_parsedIdx += m_parser.getRequestSize();
+    m_parser.setBuffer(m_readBuf.data() + m_parsedIdx);
+    auto parse_ret = parseRequest();
+    if (parse_ret == HTTPHeaderParser::Status::ERROR)
+    {
+        // 先发送前面的请求的响应，然后关闭连接
+        s_logger->warn("[client] socket {}: pipelined request parse error, close after respond", m_sockfd);
+        m_keep_connection = false;
+    }
+    return parse_ret == HTTPHeaderParser::Status::DONE;
+}
+
+HTTPHeaderParser::Status HTTPClientTask::parseRequest()
+{
+    auto parse_ret = m_parser.parseRequest(m_readIdx - m_parsedIdx);
+    if (parse_ret == HTTPHeaderParser::Status::WORKING && m_parsedIdx > 0)
+    {
+        // 之前的请求都已经生成了响应，把不完整的请求移动到缓冲区的开头，为后续的数据腾出空间
+        memmove(m_readBuf.data(), m_readBuf.data() + m_parsedIdx, m_readIdx - m_parsedIdx);
+        m_readIdx -= m_parsedIdx;
+        m_parsedIdx = 0;
+        m_parser.moveBuffer(m_readBuf.data());
+    }
+    if (parse_ret != HTTPHeaderParser::Status::DONE)
+        return parse_ret;
+    // 数据已经读取完成
+    s_logger->trace("[client] socket {}: header parse done", m_sockfd);
+    touch(Phase::WRITE);
+    auto request = m_parser.getRequestView();
+    // 是否要保持连接，HTTP/1.1默认保持连接，客户端可以不带Connection直接发送流水线请求
+    m_keep_connection = HTTPHeaderParser::keepAlive(request->version, request->get(HTTPHeaderParser::Field::CONNECTION));
+    // 不支持请求体，无法确定下一个请求从哪里开始，响应之后关闭连接
+    auto content_length = request->get(HTTPHeaderParser::Field::CONTENT_LENGTH);
+    if ((!content_length.empty() && content_length != "0") || !request->get(HTTPHeaderParser::Field::TRANSFER_ENCODING).empty())
+        m_keep_connection = false;
+    s_logger->trace("[client] socket {}: keep connection: {}", m_sockfd, m_keep_connection);
+    // 只支持GET方法和HTTP/1.1
+    m_badRequest = request->method != HTTPHeaderParser::Method::GET || request->version != "HTTP/1.1";
+    if (!m_badRequest)
+    {
         // 如果path为空，则加上index.html
-        if (req_header->path.empty())
-            req_header->path += "index.html";
-        // 是否要保持连接
-        m_keep_connection = req_header->opt.contains("Connection") &&  req_header->opt["Connection"].starts_with("keep-alive");
-        s_logger->trace("[client] socket {}: keep connection: {}", m_sockfd, m_keep_connection);
-        // 只支持GET方法和HTTP/1.1
-        if (req_header->method != HTTPHeaderParser::Method::GET || req_header->version != "HTTP/1.1")
+        // 规范化路径，使同一个文件总是对应同一个缓存项，根目录监视器按照相同的格式使缓存项失效
+        m_docPath = (s_docRoot / (request->path.empty() ? std::string_view("index.html") : request->path)).lexically_normal().string();
+        s_logger->trace("[client] socket {}: requesting doc {}", m_sockfd, m_docPath);
+    }
+    m_range = request->get(HTTPHeaderParser::Field::RANGE);
+    m_ifRange = request->get(HTTPHeaderParser::Field::IF_RANGE);
+    m_ifNoneMatch = request->get(HTTPHeaderParser::Field::IF_NONE_MATCH);
+    m_ifModifiedSince = request->get(HTTPHeaderParser::Field::IF_MODIFIED_SINCE);
+    m_acceptEncoding = request->get(HTTPHeaderParser::Field::ACCEPT_ENCODING);
+    return parse_ret;
+}
+
+void HTTPClientTask::respond()
+{
+    // 缓冲区中的流水线请求依次生成响应，之后一起发送
+    do
+    {
+        if (!m_badRequest)
+            m_fcont = s_pool->getFile(m_docPath);
+        prepareRespond();
+    } while (m_keep_connection && nextRequest());
+    Utils::modepfd(m_epfd, m_sockfd, EPOLLOUT | EPOLLET | EPOLLONESHOT | EPOLLRDHUP);
+}
+
+void HTTPClientTask::prepareRespond()
+{
+    // 响应的第一个片段为响应头，生成之后再填入
+    auto &response = m_responses.emplace_back();
+    size_t header_idx = m_segments.size();
+    m_segments.push_back({nullptr, 0, 0, nullptr});
+    if (m_badRequest || !m_fcont)
+    {
+        // 错误响应也告知客户端是否保持连接，流水线中之后的请求依赖这一点
+        HTTPHeaderParser::KVMap error_opt{{"Connection", m_keep_connection ? "keep-alive" : "close"}};
+        if (m_badRequest)
         {
             s_logger->trace("[client] socket {}: unsupport http method or version, respond BAD_REQUEST", m_sockfd);
-            m_respond_header = m_parser.getRespondHeader("HTTP/1.1", HTTPHeaderParser::StatusCode::BAD_REQUEST, std::nullopt);
+            m_fcont.reset();
+            HTTPHeaderParser::appendRespondHeader(response.header, "HTTP/1.1", HTTPHeaderParser::StatusCode::BAD_REQUEST, error_opt);
         }
         else
         {
-            std::filesystem::path docPath = s_docRoot / req_header->path;
-            s_logger->trace("[client] socket {}: requesting doc {}", m_sockfd, docPath.c_str());
-            m_fcont = s_pool->getFile(docPath.string());
-            
-            if (!m_fcont)
-            {
-                // 请求的资源不存在
-                s_logger->trace("[client] socket {}: doc not found, respond NOT_FOUND", m_sockfd);
-                m_respond_header = m_parser.getRespondHeader("HTTP/1.1", HTTPHeaderParser::StatusCode::NOT_FOUND, std::nullopt);
-            } else
+            // 请求的资源不存在
+            s_logger->trace("[client] socket {}: doc not found, respond NOT_FOUND", m_sockfd);
+            HTTPHeaderParser::appendRespondHeader(response.header, "HTTP/1.1", HTTPHeaderParser::StatusCode::NOT_FOUND, error_opt);
+        }
+    }
+    else
+    {
+        // 有预压缩文件时按照Accept-Encoding选择一个，之后的验证器、长度和区间都使用压缩后的内容
+        if (m_fcont->hasVariants())
+        {
+            for (auto encoding : HTTPHeaderParser::parseAcceptEncoding(m_acceptEncoding))
             {
-                HTTPHeaderParser::KVMap opt;
-                if (m_keep_connection)
-                    opt["Connection"] = "keep-alive";
-                else
-                    opt["Connection"] = "closed";
-                // 根据文件的后缀名生成MIME格式
-                if (mimeLookUpTable.contains(docPath.extension()))
+                if (auto variant = m_fcont->getVariant(encoding))
                 {
-                    opt["Content-Type"] = mimeLookUpTable.at(docPath.extension());
+                    s_logger->trace("[client] socket {}: respond with {} encoding", m_sockfd, HTTPHeaderParser::encoding2str(encoding));
+                    m_fcont = variant;
+                    break;
                 }
-                else
+            }
+        }
+        else if (m_fcont->getVary() && !m_acceptEncoding.empty())
+        {
+            // 动态压缩的副本在后台生成，还没有完成时发送原文件
+            for (auto encoding : HTTPHeaderParser::parseAcceptEncoding(m_acceptEncoding))
+            {
+                if (auto compressed = s_pool->getCompressed(m_fcont, encoding))
                 {
-                    opt["Content-Type"] = "application/unknown";
+                    s_logger->trace("[client] socket {}: respond with compressed {} copy", m_sockfd, HTTPHeaderParser::encoding2str(encoding));
+                    m_fcont = compressed;
+                    break;
                 }
-                opt["Content-Length"] = std::to_string(m_fcont->getStat()->st_size);
-                m_respond_header = m_parser.getRespondHeader("HTTP/1.1", HTTPHeaderParser::StatusCode::OK, opt);
             }
         }
-        m_parser.reset();
-        // 准备写入
-        m_iv[0].iov_base = (void*)m_respond_header->c_str();
-        m_iv[0].iov_len = m_respond_header->size();
-        if (m_fcont)
+        if (m_ifNoneMatch.empty() && m_ifModifiedSince.empty() && m_range.empty())
         {
-            m_iv[1].iov_base = const_cast<void*>(m_fcont->getData());
-            m_iv[1].iov_len = m_fcont->getStat()->st_size;
-        } else 
+            // 最常见的完整响应：缓存项中预先生成的响应头之后只需要拼接Date和Connection，不需要分配内存
+            auto &date = HTTPHeaderParser::currentDateHeader();
+            static const std::string_view keep_alive = "Connection: keep-alive\r\n\r\n";
+            static const std::string_view closed = "Connection: close\r\n\r\n";
+            auto connection = m_keep_connection ? keep_alive : closed;
+            size_t date_length = std::min(date.size(), sizeof(response.tail) - connection.size());
+            memcpy(response.tail, date.data(), date_length);
+            memcpy(response.tail + date_length, connection.data(), connection.size());
+            auto &block = m_fcont->getHeaderBlock();
+            m_segments[header_idx] = {block.data(), 0, static_cast<off_t>(block.size()), nullptr};
+            m_segments.push_back({response.tail, 0, static_cast<off_t>(date_length + connection.size()), nullptr});
+            addFileSegment(0, m_fcont->getStat()->st_size);
+            response.file = std::move(m_fcont);
+            return;
+        }
+        HTTPHeaderParser::KVMap opt;
+        if (m_keep_connection)
+            opt["Connection"] = "keep-alive";
+        else
+            opt["Connection"] = "close";
+        opt["Date"] = HTTPHeaderParser::formatDate(time(nullptr));
+        auto &content_type = m_fcont->getContentType();
+        if (m_fcont->getEncoding())
+            opt["Content-Encoding"] = m_fcont->getEncoding();
+        if (m_fcont->getVary())
+            opt["Vary"] = "Accept-Encoding";
+        off_t size = m_fcont->getStat()->st_size;
+        opt["ETag"] = m_fcont->getETag();
+        opt["Last-Modified"] = m_fcont->getLastModified();
+        // 条件请求：有If-None-Match时只比较ETag，否则比较If-Modified-Since与文件的修改时间
+        bool not_modified = false;
+        if (!m_ifNoneMatch.empty())
+        {
+            not_modified = HTTPHeaderParser::ifNoneMatchMatches(m_ifNoneMatch, m_fcont->getETag());
+        }
+        else if (!m_ifModifiedSince.empty())
         {
-            m_iv[1].iov_base = nullptr;
-            m_iv[1].iov_len = 0;
+            auto since = HTTPHeaderParser::parseDate(m_ifModifiedSince);
+            not_modified = since && m_fcont->getStat()->st_mtim.tv_sec <= *since;
         }
-        m_remainBytes = m_iv[0].iov_len + m_iv[1].iov_len;
-        Utils::modepfd(s_epfd, m_sockfd, EPOLLOUT | EPOLLET | EPOLLONESHOT | EPOLLRDHUP);
+        // 有Range时按照区间返回，If-Range与文件当前的版本不一致时返回整个文件
+        std::optional<std::vector<HTTPHeaderParser::ByteRange>> ranges;
+        if (!not_modified && !m_range.empty() && (m_ifRange.empty() || HTTPHeaderParser::ifRangeMatches(m_ifRange, m_fcont->getETag(), m_fcont->getLastModified())))
+        {
+            ranges = HTTPHeaderParser::parseRange(m_range, size);
+        }
+        auto code = HTTPHeaderParser::StatusCode::OK;
+        if (not_modified)
+        {
+            // 客户端缓存的版本仍然有效，不发送响应体
+            s_logger->trace("[client] socket {}: respond NOT_MODIFIED", m_sockfd);
+            code = HTTPHeaderParser::StatusCode::NOT_MODIFIED;
+        }
+        else if (!ranges)
+        {
+            opt["Accept-Ranges"] = "bytes";
+            opt["Content-Type"] = content_type;
+            opt["Content-Length"] = std::to_string(size);
+            addFileSegment(0, size);
+        }
+        else if (ranges->empty())
+        {
+            s_logger->trace("[client] socket {}: range {} not satisfiable", m_sockfd, m_range);
+            code = HTTPHeaderParser::StatusCode::RANGE_NOT_SATISFIABLE;
+            opt["Content-Range"] = "bytes */" + std::to_string(size);
+        }
+        else if (ranges->size() == 1)
+        {
+            auto &range = ranges->front();
+            code = HTTPHeaderParser::StatusCode::PARTIAL_CONTENT;
+            opt["Content-Type"] = content_type;
+            opt["Content-Range"] = "bytes " + std::to_string(range.first) + "-" + std::to_string(range.last) + "/" + std::to_string(size);
+            opt["Content-Length"] = std::to_string(range.last - range.first + 1);
+            addFileSegment(range.first, range.last - range.first + 1);
+        }
+        else
+        {
+            // 多个区间使用multipart/byteranges，每个部分的头保存在response.partHeaders中，全部生成之后再引用其中的数据
+            static thread_local std::mt19937_64 rng(std::random_device{}());
+            char boundary[17];
+            snprintf(boundary, sizeof(boundary), "%016llx", static_cast<unsigned long long>(rng()));
+            code = HTTPHeaderParser::StatusCode::PARTIAL_CONTENT;
+            auto &part_headers = response.partHeaders;
+            std::vector<size_t> part_begins;
+            off_t length = 0;
+            for (auto &range : *ranges)
+            {
+                part_begins.push_back(part_headers.size());
+                part_headers += "\r\n--";
+                part_headers += boundary;
+                part_headers += "\r\nContent-Type: " + content_type;
+                part_headers += "\r\nContent-Range: bytes " + std::to_string(range.first) + "-" + std::to_string(range.last) + "/" + std::to_string(size) + "\r\n\r\n";
+                length += range.last - range.first + 1;
+            }
+            part_begins.push_back(part_headers.size());
+            part_headers += "\r\n--";
+            part_headers += boundary;
+            part_headers += "--\r\n";
+            length += part_headers.size();
+            for (size_t i = 0; i < ranges->size(); i++)
+            {
+                m_segments.push_back({part_headers.data() + part_begins[i], 0, static_cast<off_t>(part_begins[i + 1] - part_begins[i]), nullptr});
+                addFileSegment((*ranges)[i].first, (*ranges)[i].last - (*ranges)[i].first + 1);
+            }
+            m_segments.push_back({part_headers.data() + part_begins.back(), 0, static_cast<off_t>(part_headers.size() - part_begins.back()), nullptr});
+            opt["Content-Type"] = std::string("multipart/byteranges; boundary=") + boundary;
+            opt["Content-Length"] = std::to_string(length);
+        }
+        HTTPHeaderParser::appendRespondHeader(response.header, "HTTP/1.1", code, opt);
     }
-    break;
-    case HTTPHeaderParser::Status::ERROR:
+    // 准备写入
+    m_segments[header_idx] = {response.header.data(), 0, static_cast<off_t>(response.header.size()), nullptr};
+    response.file = std::move(m_fcont);
+}
+
+void HTTPClientTask::addFileSegment(off_t offset, off_t length)
+{
+    if (m_fcont->getFd() >= 0)
     {
-        // 出现了错误，关闭连接
-        close();
-        s_logger->warn("[client] socket {}: header parse error, connection closed", m_sockfd);
+        // 大文件由sendfile从缓存的文件描述符直接发送
+        m_segments.push_back({nullptr, offset, length, m_fcont.get()});
     }
-    break;
-    default:
-        // ??
-        break;
+    else
+    {
+        m_segments.push_back({static_cast<const char *>(m_fcont->getData()) + offset, 0, length, nullptr});
     }
 }
 
 void HTTPClientTask::processWrite()
 {
-    // 执行writev
-    // 循环写入
-    while (m_remainBytes > 0) {
-        ssize_t result = writev(m_sockfd, m_iv, 2);
-        if (result > 0) {
-            s_logger->trace("[client] socket {}: write {} bytes of data", m_sockfd, result);
-            m_remainBytes -= result;
-            // 更新iovector的指针
-            for (int i = 0; i < 2; ++i) {
-                if (result >= m_iv[i].iov_len) {
-                    result -= m_iv[i].iov_len;
-                    m_iv[i].iov_len = 0;
-                } else {
-                    m_iv[i].iov_base = reinterpret_cast<char*>(m_iv[i].iov_base) + result;
-                    m_iv[i].iov_len -= result;
-                    break;
+    // 按顺序发送全部片段：连续的内存片段合并为一次sendmsg，文件描述符中的数据使用sendfile发送
+    // 每次最多用sendfile发送一个窗口，大文件不会长时间占用工作线程
+    off_t window = SENDFILE_WINDOW_SIZE;
+    while (m_segmentIdx < m_segments.size()) {
+        auto &segment = m_segments[m_segmentIdx];
+        if (segment.length == 0) {
+            m_segmentIdx++;
+            continue;
+        }
+        ssize_t result;
+        if (segment.data) {
+            iovec iv[WRITE_IOV_SIZE];
+            int count = 0;
+            size_t next = m_segmentIdx;
+            for (; next < m_segments.size() && count < WRITE_IOV_SIZE && m_segments[next].data; next++) {
+                iv[count].iov_base = const_cast<char *>(m_segments[next].data);
+                iv[count].iov_len = m_segments[next].length;
+                count++;
+            }
+            msghdr msg = {};
+            msg.msg_iov = iv;
+            msg.msg_iovlen = count;
+            // 后面还有数据要发送时使用MSG_MORE，响应头和文件的开头合并在同一个TCP报文中发送
+            result = sendmsg(m_sockfd, &msg, MSG_NOSIGNAL | (next < m_segments.size() ? MSG_MORE : 0));
+            if (result > 0) {
+                s_logger->trace("[client] socket {}: write {} bytes of data", m_sockfd, result);
+                touch(Phase::WRITE);
+                // 更新片段的指针
+                for (off_t remain = result; remain > 0; ) {
+                    auto &curr = m_segments[m_segmentIdx];
+                    off_t n = std::min(remain, curr.length);
+                    curr.data += n;
+                    curr.length -= n;
+                    remain -= n;
+                    if (curr.length == 0)
+                        m_segmentIdx++;
                 }
+                continue;
             }
-        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        } else {
+            if (window <= 0) {
+                s_logger->trace("[client] socket {}: yield after a sendfile window", m_sockfd);
+                Utils::modepfd(m_epfd, m_sockfd, EPOLLOUT | EPOLLET | EPOLLONESHOT | EPOLLRDHUP);
+                return;
+            }
+            if (window == SENDFILE_WINDOW_SIZE && segment.file->isStreaming()) {
+                // 提前读入下一个窗口
+                posix_fadvise(segment.file->getFd(), segment.offset + std::min(segment.length, window), SENDFILE_WINDOW_SIZE, POSIX_FADV_WILLNEED);
+            }
+            result = sendfile(m_sockfd, segment.file->getFd(), &segment.offset, std::min(segment.length, window));
+            if (result > 0) {
+                s_logger->trace("[client] socket {}: sendfile {} bytes of data", m_sockfd, result);
+                touch(Phase::WRITE);
+                segment.length -= result;
+                window -= result;
+                continue;
+            } else if (result == 0) {
+                // 文件在缓存之后被截断，已经无法发送声明的长度
+                s_logger->warn("[client] socket {}: unexpected end of file, connection closed", m_sockfd);
+                close();
+                return;
+            }
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
             // 等待下一轮EPOLLOUT事件
-            s_logger->trace("[client] socket {}: {} bytes to write, wait for EPOLLOUT again", m_sockfd, m_remainBytes);
-            Utils::modepfd(s_epfd, m_sockfd, EPOLLOUT | EPOLLET | EPOLLONESHOT | EPOLLRDHUP);
+            s_logger->trace("[client] socket {}: {} segments to write, wait for EPOLLOUT again", m_sockfd, m_segments.size() - m_segmentIdx);
+            Utils::modepfd(m_epfd, m_sockfd, EPOLLOUT | EPOLLET | EPOLLONESHOT | EPOLLRDHUP);
             return;
         } else {
             // 对方关闭连接或其他错误
-            s_logger->warn("[client] socket {}: writev error {}, connection closed", m_sockfd, strerror(errno));
+            s_logger->warn("[client] socket {}: write error {}, connection closed", m_sockfd, strerror(errno));
             close();
             return;
         }
     }
 
-    // 如果写入完毕，则释放文件引用并等待EPOLLIN事件
-    s_logger->trace("[client] socket {}: write done", m_sockfd);
-    m_fcont.reset();
+    // 如果写入完毕，则释放这一批响应并等待EPOLLIN事件
+    s_logger->trace("[client] socket {}: write done, {} responses", m_sockfd, m_responses.size());
+    m_responses.clear();
+    m_segments.clear();
+    m_segmentIdx = 0;
     if (!m_keep_connection)
     {
         close();
+        return;
     }
-    Utils::modepfd(s_epfd, m_sockfd, EPOLLIN | EPOLLET | EPOLLONESHOT | EPOLLRDHUP);
+    // 缓冲区中还有不完整的流水线请求时，继续计算接收请求头的超时
+    touch(m_readIdx > 0 ? Phase::HEADER : Phase::IDLE);
+    Utils::modepfd(m_epfd, m_sockfd, EPOLLIN | EPOLLET | EPOLLONESHOT | EPOLLRDHUP);
 }
 
 bool HTTPClientTask::read()
@@ -236,7 +581,8 @@ bool HTTPClientTask::read()
     if (m_readIdx >= m_readBuf.size())
         return false;
 
-    for (;;)
+    // 缓冲区已满时停止读取，剩下的数据在缓冲区中的请求处理完之后再读取
+    while (m_readIdx < static_cast<int>(m_readBuf.size()))
     {
         int ret = recv(m_sockfd, m_readBuf.data() + m_readIdx, m_readBuf.size() - m_readIdx, 0);
         if (ret == -1)
@@ -255,7 +601,43 @@ bool HTTPClientTask::read()
         }
         m_readIdx += ret;
         s_logger->trace("[client] socket {}: read {} bytes of data", m_sockfd, ret);
+        // 收到了新请求的第一部分数据，请求头的超时从这里开始计算
+        if (m_phase == Phase::IDLE)
+            touch(Phase::HEADER);
     }
 
     return true;
 }
+
+void HTTPClientTask::touch(Phase phase)
+{
+    m_lastActive = std::chrono::high_resolution_clock::now().time_since_epoch().count();
+    m_phase = phase;
+}
+
+int HTTPClientTask::getEpfd() const
+{
+    return m_epfd;
+}
+
+HTTPClientTask::Phase HTTPClientTask::getPhase() const
+{
+    return m_phase;
+}
+
+std::optional<std::chrono::high_resolution_clock::time_point> HTTPClientTask::getDeadline() const
+{
+    if (m_sockfd < 0)
+        return std::nullopt;
+    std::chrono::high_resolution_clock::time_point last_active(std::chrono::high_resolution_clock::duration(m_lastActive.load()));
+    switch (m_phase.load())
+    {
+    case Phase::HEADER:
+        return last_active + s_headerTimeout;
+    case Phase::WRITE:
+        return last_active + s_writeTimeout;
+    case Phase::IDLE:
+    default:
+        return last_active + s_idleTimeout;
+    }
+}
@@ -1,7 +1,39 @@
 #include "httpheaderparser.h"
+#include "headerscan.h"
 
-HTTPHeaderParser::HTTPHeaderParser()
-    : m_buf(nullptr), m_parsePos(0), m_readPos(0), m_lineStartPos(0), m_headerFieldValueStartPos(0),
+#include <algorithm>
+#include <array>
+#include <unordered_set>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string_view>
+
+namespace
+{
+    // ASCII的大小写不敏感比较，请求头的名称和编码名称都只包含ASCII字符
+    bool iequals(std::string_view a, std::string_view b)
+    {
+        auto lower = [](char c) {
+            return c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+        };
+        return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [&lower](char x, char y) {
+            return lower(x) == lower(y);
+        });
+    }
+
+    std::string_view trim(std::string_view str)
+    {
+        auto begin = str.find_first_not_of(" \t");
+        if (begin == std::string_view::npos)
+            return std::string_view();
+        return str.substr(begin, str.find_last_not_of(" \t") - begin + 1);
+    }
+}
+
+HTTPHeaderParser::HTTPHeaderParser(Mode mode)
+    : m_buf(nullptr), m_parsePos(0), m_readPos(0), m_lineStartPos(0), m_headerColonPos(0), m_mode(mode),
       m_parseStatus(HTTPHeaderParser::_InternalStatus::CHECK_STARTLINE), m_parseLineStatus(HTTPHeaderParser::_InternalLineStatus::LINE_OK)
 {
     m_respondHeader.reserve(128);
@@ -17,9 +49,13 @@ void HTTPHeaderParser::reset()
     m_parsePos = 0;
     m_readPos = 0;
     m_lineStartPos = 0;
-    m_headerFieldValueStartPos = 0;
+    m_headerColonPos = 0;
     m_parseStatus = HTTPHeaderParser::_InternalStatus::CHECK_STARTLINE;
     m_parseLineStatus = HTTPHeaderParser::_InternalLineStatus::LINE_OK;
+    // 上一个请求的键值对不能带到同一个连接的下一个请求中
+    m_requestHeader.opt.clear();
+    m_requestView.count = 0;
+    m_requestView.fields.fill(std::string_view());
 }
 
 void HTTPHeaderParser::setBuffer(char *buf)
@@ -28,6 +64,34 @@ void HTTPHeaderParser::setBuffer(char *buf)
     reset();
 }
 
+int HTTPHeaderParser::getRequestSize() const
+{
+    // 最后一行的\n之后
+    return m_parsePos + 1;
+}
+
+void HTTPHeaderParser::moveBuffer(char *buf)
+{
+    // 只移动指向已读取数据的视图，空的视图不指向缓冲区
+    auto rebase = [this, buf](std::string_view &view)
+    {
+        if (std::less_equal<const char *>{}(m_buf, view.data()) && std::less_equal<const char *>{}(view.data(), m_buf + m_readPos))
+            view = std::string_view(buf + (view.data() - m_buf), view.size());
+    };
+    rebase(m_requestView.version);
+    rebase(m_requestView.path);
+    for (size_t i = 0; i < m_requestView.count; i++)
+    {
+        rebase(m_requestView.headers[i].name);
+        rebase(m_requestView.headers[i].value);
+    }
+    for (auto &field : m_requestView.fields)
+    {
+        rebase(field);
+    }
+    m_buf = buf;
+}
+
 HTTPHeaderParser::Status HTTPHeaderParser::parseRequest(int read_pos)
 {
     m_readPos = read_pos;
@@ -53,12 +117,25 @@ HTTPHeaderParser::Status HTTPHeaderParser::parseRequest(int read_pos)
             {
                 return HTTPHeaderParser::Status::DONE;
             }
-            // 向opt添加键值对
-            else if (m_parsePos > m_headerFieldValueStartPos && m_headerFieldValueStartPos > m_lineStartPos)
+            // 名称为冒号之前的部分，值为冒号之后去掉两端空白的部分
+            else if (m_headerColonPos > m_lineStartPos)
             {
-                auto headerKey = std::string(m_buf + m_lineStartPos, m_headerFieldValueStartPos - m_lineStartPos - 2);
-                auto headerVal = std::string(m_buf + m_headerFieldValueStartPos, m_parsePos - m_headerFieldValueStartPos - 1);
-                m_requestHeader.opt[headerKey] = headerVal;
+                std::string_view name(m_buf + m_lineStartPos, m_headerColonPos - m_lineStartPos);
+                auto value = trim(std::string_view(m_buf + m_headerColonPos + 1, m_parsePos - m_headerColonPos - 2));
+                // 数组已满时不再记录其他的请求头，已知字段和MAP模式的映射仍然照常填写
+                if (m_requestView.count < MAX_HEADER_COUNT)
+                {
+                    m_requestView.headers[m_requestView.count++] = {name, value};
+                }
+                auto field = str2field(name);
+                if (field != Field::UNKNOWN)
+                {
+                    m_requestView.fields[static_cast<size_t>(field)] = value;
+                }
+                if (m_mode == Mode::MAP)
+                {
+                    m_requestHeader.opt[std::string(name)] = std::string(value);
+                }
             }
             else
             {
@@ -86,114 +163,440 @@ HTTPHeaderParser::RequestHeader *HTTPHeaderParser::getRequestHeader()
     return &m_requestHeader;
 }
 
-std::string *HTTPHeaderParser::getRespondHeader(std::string version, StatusCode code, std::optional<KVMap> opt)
+const HTTPHeaderParser::RequestView *HTTPHeaderParser::getRequestView() const
+{
+    return &m_requestView;
+}
+
+std::string_view HTTPHeaderParser::RequestView::find(std::string_view name) const
+{
+    auto field = str2field(name);
+    if (field != Field::UNKNOWN)
+        return get(field);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (iequals(headers[i].name, name))
+            return headers[i].value;
+    }
+    return std::string_view();
+}
+
+HTTPHeaderParser::Field HTTPHeaderParser::str2field(std::string_view name)
+{
+    static constexpr std::array<std::string_view, FIELD_COUNT> names = {
+        "Host",
+        "Connection",
+        "Range",
+        "If-Range",
+        "If-None-Match",
+        "If-Modified-Since",
+        "Accept-Encoding",
+        "Content-Length",
+        "Transfer-Encoding",
+        "User-Agent",
+    };
+    for (size_t i = 0; i < FIELD_COUNT; i++)
+    {
+        if (iequals(names[i], name))
+            return static_cast<Field>(i);
+    }
+    return Field::UNKNOWN;
+}
+
+std::string *HTTPHeaderParser::getRespondHeader(std::string_view version, StatusCode code, const KVMap &opt)
 {
     m_respondHeader.clear();
+    appendRespondHeader(m_respondHeader, version, code, opt);
+    return &m_respondHeader;
+}
+
+void HTTPHeaderParser::appendRespondHeader(std::string &out, std::string_view version, StatusCode code, const KVMap &opt)
+{
     // 第一行
-    m_respondHeader += version;
-    m_respondHeader += ' ';
+    out += version;
+    out += ' ';
     auto codestr = status2str(code);
-    m_respondHeader += codestr;
-    m_respondHeader += "\r\n";
+    out += codestr;
+    out += "\r\n";
     // 后续的键值对
-    if (code != StatusCode::OK)
+    for (const auto &[k, v] : opt)
+    {
+        out += k;
+        out += ": ";
+        out += v;
+        out += "\r\n";
+    }
+    if (code != StatusCode::OK && code != StatusCode::PARTIAL_CONTENT && code != StatusCode::NOT_MODIFIED)
     {
-        m_respondHeader += "Content-Length: ";
-        m_respondHeader += std::to_string(codestr.size());
-        m_respondHeader += "\r\n";
+        out += "Content-Length: ";
+        out += std::to_string(codestr.size());
+        out += "\r\n";
         // 最后的空行
-        m_respondHeader += "\r\n";
+        out += "\r\n";
         // 如果不是200 OK，那么加上一个基本的错误码
-        m_respondHeader += codestr;
+        out += codestr;
     }
     else
     {
-        if (opt)
-        {
-            for (const auto &[k, v] : opt.value())
-            {
-                m_respondHeader += k;
-                m_respondHeader += ": ";
-                m_respondHeader += v;
-                m_respondHeader += "\r\n";
-            }
-        }
         // 最后的空行
-        m_respondHeader += "\r\n";
+        out += "\r\n";
     }
-    
-    return &m_respondHeader;
 }
 
-HTTPHeaderParser::_InternalLineStatus HTTPHeaderParser::parseLine()
+std::optional<std::vector<HTTPHeaderParser::ByteRange>> HTTPHeaderParser::parseRange(std::string_view value, off_t size)
 {
-    char temp;
-    for (; m_parsePos < m_readPos; m_parsePos++)
+    // 只支持bytes单位，格式为bytes=first-last, first-, -suffix，以逗号分隔
+    if (!value.starts_with("bytes="))
+        return std::nullopt;
+    std::vector<ByteRange> ranges;
+    size_t count = 0;
+    off_t total = 0;
+    size_t pos = 6;
+    while (pos <= value.size())
     {
-        temp = m_buf[m_parsePos];
-        // 分以下情况
-        // 如果当前字符是本行中第一个出现的冒号，则将位置+2作为HeaderFieldValue的起点
-        if (temp == ':')
+        auto end = value.find(',', pos);
+        if (end == std::string_view::npos)
+            end = value.size();
+        // 去掉两端的空白
+        auto spec = trim(value.substr(pos, end - pos));
+        pos = end + 1;
+        if (spec.empty())
+            continue;
+        auto dash = spec.find('-');
+        if (dash == std::string_view::npos)
+            return std::nullopt;
+        auto first_str = spec.substr(0, dash);
+        auto last_str = spec.substr(dash + 1);
+        auto to_number = [](std::string_view str) {
+            off_t number = 0;
+            std::from_chars(str.data(), str.data() + str.size(), number);
+            return number;
+        };
+        auto is_number = [](std::string_view str) {
+            // 最多18位，不会溢出off_t
+            return !str.empty() && str.size() <= 18 && str.find_first_not_of("0123456789") == std::string::npos;
+        };
+        if ((!first_str.empty() && !is_number(first_str)) || (!last_str.empty() && !is_number(last_str)))
+            return std::nullopt;
+        if (++count > MAX_RANGE_COUNT)
+            return std::nullopt;
+        ByteRange range;
+        if (first_str.empty())
         {
-            if (m_headerFieldValueStartPos <= m_lineStartPos)
-                m_headerFieldValueStartPos = m_parsePos + 2;
+            // 最后suffix个字节
+            if (last_str.empty())
+                return std::nullopt;
+            off_t suffix = to_number(last_str);
+            if (suffix == 0 || size == 0)
+                continue;
+            range = {std::max<off_t>(size - suffix, 0), size - 1};
         }
-        // 如果当前字符是\n，则检查上一个字符是不是\r
-        else if (temp == '\n')
+        else
         {
-            if (m_parsePos >= 1 && m_buf[m_parsePos - 1] == '\r')
+            range.first = to_number(first_str);
+            range.last = last_str.empty() ? std::max<off_t>(size - 1, range.first) : to_number(last_str);
+            if (range.last < range.first)
+                return std::nullopt;
+            // 起点超出文件的区间无法满足
+            if (range.first >= size)
+                continue;
+            range.last = std::min(range.last, size - 1);
+        }
+        total += range.last - range.first + 1;
+        ranges.push_back(range);
+    }
+    if (count == 0)
+        return std::nullopt;
+    // 重叠的区间可能被用来放大流量，总长度超过文件本身时直接返回整个文件
+    if (total > size)
+        return std::nullopt;
+    return ranges;
+}
+
+std::string HTTPHeaderParser::formatDate(time_t time)
+{
+    static const char *days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+    static const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    struct tm tm;
+    gmtime_r(&time, &tm);
+    // 不使用strftime，避免受到locale的影响
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%s, %02d %s %04d %02d:%02d:%02d GMT", days[tm.tm_wday], tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    return buf;
+}
+
+const std::string &HTTPHeaderParser::currentDateHeader()
+{
+    static thread_local time_t last = -1;
+    static thread_local std::string header;
+    time_t now = time(nullptr);
+    if (now != last)
+    {
+        last = now;
+        header = "Date: " + formatDate(now) + "\r\n";
+    }
+    return header;
+}
+
+std::string HTTPHeaderParser::makeETag(const struct stat &fstat)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "\"%lx-%lx-%lx\"", static_cast<unsigned long>(fstat.st_mtim.tv_sec), static_cast<unsigned long>(fstat.st_mtim.tv_nsec), static_cast<unsigned long>(fstat.st_size));
+    return buf;
+}
+
+bool HTTPHeaderParser::ifRangeMatches(std::string_view value, std::string_view etag, std::string_view last_modified)
+{
+    // 弱验证的ETag永远不匹配
+    if (value.starts_with("W/"))
+        return false;
+    if (value.starts_with("\""))
+        return value == etag;
+    return value == last_modified;
+}
+
+HTTPHeaderParser::EncodingList HTTPHeaderParser::parseAcceptEncoding(std::string_view value)
+{
+    // 每一项为coding;q=value，没有出现的编码使用*的q值，都没有时不可接受
+    std::array<double, ENCODING_COUNT> qvalues;
+    std::array<bool, ENCODING_COUNT> listed = {};
+    qvalues.fill(0);
+    std::string_view list = value;
+    while (!list.empty())
+    {
+        auto end = list.find(',');
+        auto item = list.substr(0, end);
+        list = end == std::string_view::npos ? std::string_view() : list.substr(end + 1);
+        double q = 1;
+        auto semicolon = item.find(';');
+        if (semicolon != std::string_view::npos)
+        {
+            auto param = trim(item.substr(semicolon + 1));
+            if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=')
             {
-                m_buf[m_parsePos] = '\0';
-                m_buf[m_parsePos - 1] = '\0';
-                return HTTPHeaderParser::_InternalLineStatus::LINE_OK;
+                // q值无效时按照0处理
+                q = 0;
+                param.remove_prefix(2);
+                std::from_chars(param.data(), param.data() + param.size(), q);
             }
-            else
+            item = item.substr(0, semicolon);
+        }
+        auto coding = trim(item);
+        if (coding.empty())
+            continue;
+        for (size_t i = 0; i < ENCODING_COUNT; i++)
+        {
+            auto encoding = static_cast<Encoding>(i);
+            bool match = iequals(coding, encoding2str(encoding)) || (encoding == Encoding::GZIP && iequals(coding, "x-gzip"));
+            if (match || (coding == "*" && !listed[i]))
             {
-                return HTTPHeaderParser::_InternalLineStatus::LINE_BAD;
+                qvalues[i] = q;
+                listed[i] = listed[i] || match;
             }
         }
     }
+    // 按照q值插入排序，q值相同时保持服务器的偏好顺序；std::stable_sort可能申请临时缓冲区
+    EncodingList encodings;
+    for (size_t i = 0; i < ENCODING_COUNT; i++)
+    {
+        if (qvalues[i] <= 0)
+            continue;
+        size_t pos = encodings.count++;
+        while (pos > 0 && qvalues[static_cast<size_t>(encodings.items[pos - 1])] < qvalues[i])
+        {
+            encodings.items[pos] = encodings.items[pos - 1];
+            pos--;
+        }
+        encodings.items[pos] = static_cast<Encoding>(i);
+    }
+    return encodings;
+}
+
+const char *HTTPHeaderParser::encoding2str(Encoding encoding)
+{
+    switch (encoding)
+    {
+    case Encoding::BR:
+        return "br";
+    case Encoding::ZSTD:
+        return "zstd";
+    case Encoding::GZIP:
+    default:
+        return "gzip";
+    }
+}
+
+const char *HTTPHeaderParser::encodingExtension(Encoding encoding)
+{
+    switch (encoding)
+    {
+    case Encoding::BR:
+        return ".br";
+    case Encoding::ZSTD:
+        return ".zst";
+    case Encoding::GZIP:
+    default:
+        return ".gz";
+    }
+}
+
+bool HTTPHeaderParser::isCompressibleType(std::string_view content_type)
+{
+    static const std::unordered_set<std::string> compressible = {
+        "application/javascript",
+        "application/ecmascript",
+        "application/json",
+        "application/xml",
+        "application/xml-dtd",
+        "application/wasm",
+        "application/x-sh",
+        "application/postscript",
+        "application/rtf",
+        "application/vnd.ms-fontobject",
+        "font/otf",
+        "font/ttf",
+        "image/bmp",
+        "image/x-icon",
+    };
+    auto type = content_type.substr(0, content_type.find(';'));
+    return type.starts_with("text/") || type.ends_with("+xml") || type.ends_with("+json") || compressible.contains(std::string(type));
+}
+
+std::optional<time_t> HTTPHeaderParser::parseDate(std::string_view value)
+{
+    // strptime需要以\0结尾的字符串，有效的日期不会超过缓冲区
+    char buf[64];
+    if (value.size() >= sizeof(buf))
+        return std::nullopt;
+    memcpy(buf, value.data(), value.size());
+    buf[value.size()] = '\0';
+    // 依次尝试IMF-fixdate、RFC 850和asctime格式，strptime在C locale下解析星期和月份的英文缩写
+    for (auto format : {"%a, %d %b %Y %H:%M:%S GMT", "%A, %d-%b-%y %H:%M:%S GMT", "%a %b %e %H:%M:%S %Y"})
+    {
+        struct tm tm = {};
+        auto end = strptime(buf, format, &tm);
+        if (end != nullptr && *end == '\0')
+            return timegm(&tm);
+    }
+    return std::nullopt;
+}
+
+bool HTTPHeaderParser::ifNoneMatchMatches(std::string_view value, std::string_view etag)
+{
+    // 弱比较：忽略W/前缀，只比较引号中的内容
+    auto opaque = [](std::string_view tag) {
+        if (tag.starts_with("W/"))
+            tag.remove_prefix(2);
+        return tag;
+    };
+    std::string_view list = value;
+    while (!list.empty())
+    {
+        auto end = list.find(',');
+        auto tag = trim(list.substr(0, end));
+        list = end == std::string_view::npos ? std::string_view() : list.substr(end + 1);
+        if (tag.empty())
+            continue;
+        if (tag == "*" || opaque(tag) == opaque(etag))
+            return true;
+    }
+    return false;
+}
+
+bool HTTPHeaderParser::hasToken(std::string_view value, std::string_view token)
+{
+    while (!value.empty())
+    {
+        auto end = value.find(',');
+        if (iequals(trim(value.substr(0, end)), token))
+            return true;
+        value = end == std::string_view::npos ? std::string_view() : value.substr(end + 1);
+    }
+    return false;
+}
+
+bool HTTPHeaderParser::keepAlive(std::string_view version, std::string_view connection)
+{
+    if (version == "HTTP/1.1")
+        return !hasToken(connection, "close");
+    return hasToken(connection, "keep-alive");
+}
+
+HTTPHeaderParser::_InternalLineStatus HTTPHeaderParser::parseLine()
+{
+    // 一次跳过一段不含分隔符的数据：本行还没有出现冒号时查找冒号和\n，之后只查找\n
+    // 已经扫描过的数据不会被再次扫描，请求头分多次到达时从上次停下的位置继续
+    while (m_parsePos < m_readPos)
+    {
+        bool colon_found = m_headerColonPos > m_lineStartPos;
+        m_parsePos += HeaderScan::find(m_buf + m_parsePos, m_readPos - m_parsePos, colon_found ? '\n' : ':', '\n');
+        if (m_parsePos >= m_readPos)
+            break;
+        // 记录本行中第一个出现的冒号，它是请求头名称和值的分界
+        if (m_buf[m_parsePos] == ':')
+        {
+            m_headerColonPos = m_parsePos++;
+            continue;
+        }
+        // 当前字符是\n，则检查上一个字符是不是\r
+        if (m_parsePos >= 1 && m_buf[m_parsePos - 1] == '\r')
+        {
+            m_buf[m_parsePos] = '\0';
+            m_buf[m_parsePos - 1] = '\0';
+            return HTTPHeaderParser::_InternalLineStatus::LINE_OK;
+        }
+        else
+        {
+            return HTTPHeaderParser::_InternalLineStatus::LINE_BAD;
+        }
+    }
 
     return HTTPHeaderParser::_InternalLineStatus::LINE_OPEN;
 }
 
 bool HTTPHeaderParser::parseStartLine()
 {
-    std::string startLine(m_buf);
+    // parseLine已经把行尾的\r\n替换为\0
+    std::string_view startLine(m_buf + m_lineStartPos, m_parsePos - m_lineStartPos - 1);
     // 找到第一个分隔符
     auto pos1 = startLine.find(' ');
-    if (pos1 == std::string::npos)
+    if (pos1 == std::string_view::npos)
         return false;
-    std::string methodstr(m_buf, pos1);
-    auto method = str2method(methodstr);
+    auto method = str2method(startLine.substr(0, pos1));
     if (method == HTTPHeaderParser::Method::UNKNOWN)
         return false;
-    m_requestHeader.method = method;
+    m_requestView.method = method;
     // 找到第二个分隔符，中间的内容为path
     auto pos2 = startLine.find(' ', pos1 + 1);
-    if (pos2 == std::string::npos)
+    if (pos2 == std::string_view::npos)
         return false;
     // 预处理，path只能以 以http://开头，则将其移除
-    auto pathstr = std::string(startLine, pos1 + 1, pos2 - pos1 - 1);
-    if (pathstr.starts_with("http://"))
+    auto path = startLine.substr(pos1 + 1, pos2 - pos1 - 1);
+    if (path.starts_with("http://"))
     {
-        pathstr = std::string(pathstr, 7);
+        path.remove_prefix(7);
     }
-    else if (pathstr.starts_with("/"))
+    else if (path.starts_with("/"))
     {
-        pathstr = std::string(pathstr, 1);
+        path.remove_prefix(1);
     }
     else
     {
         return false;
     }
-    m_requestHeader.path = pathstr;
+    m_requestView.path = path;
     // 剩下的部分为HTTP版本
-    m_requestHeader.version = std::string(startLine, pos2 + 1);
+    m_requestView.version = startLine.substr(pos2 + 1);
+    if (m_mode == Mode::MAP)
+    {
+        m_requestHeader.method = method;
+        m_requestHeader.path = path;
+        m_requestHeader.version = m_requestView.version;
+    }
     return true;
 }
 
-HTTPHeaderParser::Method HTTPHeaderParser::str2method(const std::string &str)
+HTTPHeaderParser::Method HTTPHeaderParser::str2method(std::string_view str)
 {
     if (str == "GET")
     {
@@ -237,9 +640,9 @@ HTTPHeaderParser::Method HTTPHeaderParser::str2method(const std::string &str)
     }
 }
 
-std::string HTTPHeaderParser::status2str(StatusCode status)
+std::string_view HTTPHeaderParser::status2str(StatusCode status)
 {
-    std::string statusstr;
+    std::string_view statusstr;
     switch (status)
     {
     case StatusCode::CONTINUE:
@@ -248,6 +651,9 @@ std::string HTTPHeaderParser::status2str(StatusCode status)
     case StatusCode::OK:
         statusstr = "200 OK";
         break;
+    case StatusCode::PARTIAL_CONTENT:
+        statusstr = "206 Partial Content";
+        break;
     case StatusCode::MOVED_PERMANENTLY:
         statusstr = "301 Moved Permanently";
         break;
@@ -275,6 +681,9 @@ std::string HTTPHeaderParser::status2str(StatusCode status)
     case StatusCode::PROXY_AUTHENTICATION_REQUIRED:
         statusstr = "407 Proxy Authentication Required";
         break;
+    case StatusCode::RANGE_NOT_SATISFIABLE:
+        statusstr = "416 Range Not Satisfiable";
+        break;
     case StatusCode::INTERNAL_SERVER_ERROR:
         statusstr = "500 Internal Server Error";
         break;
@@ -0,0 +1,92 @@
+#include "mimetypes.h"
+#include "constants.h"
+
+#include <algorithm>
+
+namespace
+{
+    constexpr PerfectHashTable s_builtin(mimeLookUpTable);
+    using Table = decltype(s_builtin);
+
+    // 编译期检查：内置表中的每一个后缀名都能查到，不存在的后缀名查不到
+    static_assert(s_builtin.find(".html") == "text/html");
+    static_assert(s_builtin.find(".CSS") == "text/css");
+    static_assert(s_builtin.find(".mp3") == "audio/mpeg");
+    static_assert(s_builtin.find(".xxx").empty());
+    static_assert(s_builtin.find("").empty());
+    static_assert([]
+                  {
+                      for (auto &entry : mimeLookUpTable)
+                      {
+                          if (s_builtin.find(entry.first) != entry.second)
+                              return false;
+                      }
+                      return true; }());
+
+    // 不区分大小写的字典序，用于在覆盖表中二分查找
+    bool iless(std::string_view a, std::string_view b)
+    {
+        return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), [](char x, char y)
+                                            { return Table::tolower(x) < Table::tolower(y); });
+    }
+}
+
+MimeTypes::MimeTypes(const std::vector<std::pair<std::string, std::string>> &overrides)
+{
+    for (auto &[extension, type] : overrides)
+    {
+        std::string key = extension.starts_with('.') ? extension : "." + extension;
+        std::transform(key.begin(), key.end(), key.begin(), Table::tolower);
+        auto it = std::lower_bound(m_overrides.begin(), m_overrides.end(), key, [](auto &entry, const std::string &key)
+                                   { return entry.first < key; });
+        if (it != m_overrides.end() && it->first == key)
+        {
+            it->second = type;
+        }
+        else
+        {
+            m_overrides.emplace(it, key, type);
+        }
+    }
+}
+
+std::string_view MimeTypes::lookup(std::string_view extension) const
+{
+    if (!m_overrides.empty())
+    {
+        auto it = std::lower_bound(m_overrides.begin(), m_overrides.end(), extension, [](auto &entry, std::string_view key)
+                                   { return iless(entry.first, key); });
+        if (it != m_overrides.end() && Table::iequals(it->first, extension))
+        {
+            return it->second;
+        }
+    }
+    auto type = s_builtin.find(extension);
+    return type.empty() ? DEFAULT_TYPE : type;
+}
+
+std::string_view MimeTypes::lookupPath(std::string_view path) const
+{
+    return lookup(extension(path));
+}
+
+size_t MimeTypes::overrideCount() const
+{
+    return m_overrides.size();
+}
+
+std::string_view MimeTypes::builtin(std::string_view extension)
+{
+    return s_builtin.find(extension);
+}
+
+std::string_view MimeTypes::extension(std::string_view path)
+{
+    auto filename = path.substr(path.find_last_of('/') + 1);
+    auto dot = filename.find_last_of('.');
+    if (dot == std::string_view::npos || dot == 0 || filename == "..")
+    {
+        return {};
+    }
+    return filename.substr(dot);
+}
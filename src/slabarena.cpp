@@ -0,0 +1,169 @@
+#include "slabarena.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+SlabArena::SlabArena(size_t max_block, size_t slab_size)
+{
+    // 最小的块为64字节，正好是一个缓存行
+    size_t min_block = 64;
+    m_maxBlock = std::max(max_block, min_block);
+    // slab按照自身的大小对齐，需要是2的幂
+    m_slabSize = std::bit_ceil(std::max(slab_size, m_maxBlock));
+    for (size_t base = min_block; m_blockSizes.empty() || m_blockSizes.back() < m_maxBlock; base *= 2)
+    {
+        for (size_t i = 0; i < 4 && (m_blockSizes.empty() || m_blockSizes.back() < m_maxBlock); i++)
+        {
+            m_blockSizes.push_back(base + base / 4 * i);
+        }
+    }
+    m_classes.reset(new SizeClass[m_blockSizes.size()]);
+    for (size_t i = 0; i < m_blockSizes.size(); i++)
+    {
+        m_classes[i].blockSize = m_blockSizes[i];
+    }
+}
+
+SlabArena::~SlabArena()
+{
+    for (size_t i = 0; i < m_blockSizes.size(); i++)
+    {
+        for (auto &[base, slab] : m_classes[i].slabs)
+        {
+            munmap(base, m_slabSize);
+        }
+    }
+}
+
+void *SlabArena::allocate(size_t size)
+{
+    int index = classIndex(size);
+    if (index < 0)
+        return nullptr;
+    auto &sc = m_classes[index];
+    std::scoped_lock locker(sc.lock);
+    if (!sc.partial)
+    {
+        // 没有空闲块，申请新的slab；匿名映射只有被写入的页才会占用物理内存
+        char *base = mapSlab();
+        if (!base)
+            return nullptr;
+        auto &slab = sc.slabs[base];
+        slab.cursor = base;
+        slab.end = base + m_slabSize / sc.blockSize * sc.blockSize;
+        linkPartial(sc, slab);
+    }
+    auto &slab = *sc.partial;
+    void *block;
+    if (slab.freeList)
+    {
+        block = slab.freeList;
+        slab.freeList = slab.freeList->next;
+    }
+    else
+    {
+        block = slab.cursor;
+        slab.cursor += sc.blockSize;
+    }
+    slab.live++;
+    if (!slab.freeList && slab.cursor + sc.blockSize > slab.end)
+    {
+        unlinkPartial(sc, slab);
+    }
+    return block;
+}
+
+void SlabArena::deallocate(void *ptr, size_t size)
+{
+    int index = classIndex(size);
+    if (index < 0 || !ptr)
+        return;
+    auto &sc = m_classes[index];
+    char *base = reinterpret_cast<char *>(reinterpret_cast<uintptr_t>(ptr) & ~(m_slabSize - 1));
+    std::scoped_lock locker(sc.lock);
+    auto it = sc.slabs.find(base);
+    if (it == sc.slabs.end())
+        return;
+    auto &slab = it->second;
+    if (--slab.live == 0)
+    {
+        // slab中的块全部被释放，归还系统
+        unlinkPartial(sc, slab);
+        munmap(base, m_slabSize);
+        sc.slabs.erase(it);
+        return;
+    }
+    auto block = static_cast<FreeBlock *>(ptr);
+    block->next = slab.freeList;
+    slab.freeList = block;
+    linkPartial(sc, slab);
+}
+
+size_t SlabArena::blockSize(size_t size) const
+{
+    int index = classIndex(size);
+    return index < 0 ? 0 : m_blockSizes[index];
+}
+
+size_t SlabArena::maxBlock() const
+{
+    return m_maxBlock;
+}
+
+size_t SlabArena::getReservedSize()
+{
+    size_t reserved = 0;
+    for (size_t i = 0; i < m_blockSizes.size(); i++)
+    {
+        std::scoped_lock locker(m_classes[i].lock);
+        reserved += m_classes[i].slabs.size() * m_slabSize;
+    }
+    return reserved;
+}
+
+int SlabArena::classIndex(size_t size) const
+{
+    if (size == 0 || size > m_maxBlock)
+        return -1;
+    return std::lower_bound(m_blockSizes.begin(), m_blockSizes.end(), size) - m_blockSizes.begin();
+}
+
+char *SlabArena::mapSlab()
+{
+    // 多申请一个slab的大小，然后去掉对齐之前和之后多余的部分
+    void *addr = mmap(nullptr, m_slabSize * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED)
+        return nullptr;
+    char *start = static_cast<char *>(addr);
+    char *base = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(start) + m_slabSize - 1) & ~(m_slabSize - 1));
+    if (base > start)
+        munmap(start, base - start);
+    munmap(base + m_slabSize, start + m_slabSize * 2 - (base + m_slabSize));
+    return base;
+}
+
+void SlabArena::linkPartial(SizeClass &sc, Slab &slab)
+{
+    if (slab.partial)
+        return;
+    slab.partial = true;
+    slab.prev = nullptr;
+    slab.next = sc.partial;
+    if (sc.partial)
+        sc.partial->prev = &slab;
+    sc.partial = &slab;
+}
+
+void SlabArena::unlinkPartial(SizeClass &sc, Slab &slab)
+{
+    if (!slab.partial)
+        return;
+    slab.partial = false;
+    if (slab.prev)
+        slab.prev->next = slab.next;
+    else
+        sc.partial = slab.next;
+    if (slab.next)
+        slab.next->prev = slab.prev;
+}
@@ -1,4 +1,5 @@
 #include "staticserver.h"
+#include "compressor.h"
 
 #include <nlohmann/json.hpp>
 #include <fstream>
@@ -7,11 +8,8 @@ StaticServer *StaticServer::s_instance = nullptr;
 int StaticServer::s_fd_sigpipe[2];
 std::shared_ptr<spdlog::logger> StaticServer::s_logger;
 
-StaticServer::StaticServer()
+StaticServer::StaticServer() : m_clients(MAX_FD_SIZE)
 {
-    m_clients.resize(MAX_FD_SIZE);
-    m_timers.resize(MAX_FD_SIZE);
-    m_epevents.resize(MAX_FD_SIZE);
 }
 
 StaticServer::~StaticServer()
@@ -58,100 +56,252 @@ bool StaticServer::init()
     uint16_t port = configJson["port"].is_number_unsigned() ? configJson["port"].get<uint16_t>() : 12345;
     s_logger->info("[init] host and port is set to {}:{}", host, port);
     // backlog size
-    int backlog = configJson["backlog"].is_number_unsigned() ? configJson["backlog"].get<int>() : 5;
-    s_logger->info("[init] backlog size is set to {}", backlog);
-    // 连接超时
-    m_connection_timeout = configJson["timeout"].is_number_unsigned() ? configJson["timeout"].get<int>() : 10;
-    s_logger->info("[init] connection timeout is set to {}s", m_connection_timeout);
+    m_backlog = configJson["backlog"].is_number_unsigned() ? configJson["backlog"].get<int>() : 5;
+    s_logger->info("[init] backlog size is set to {}", m_backlog);
+    // 连接超时，timeout以秒为单位，timeouts中的各项以毫秒为单位，分别对应等待新请求、接收请求头和写入响应三个阶段
+    int connection_timeout = configJson["timeout"].is_number_unsigned() ? configJson["timeout"].get<int>() : 10;
+    int idle_timeout = connection_timeout * 1000, header_timeout = idle_timeout, write_timeout = idle_timeout;
+    if (configJson["timeouts"].is_object())
+    {
+        auto &timeoutsconfigjson = configJson["timeouts"];
+        idle_timeout = timeoutsconfigjson["idle"].is_number_unsigned() ? timeoutsconfigjson["idle"].get<int>() : idle_timeout;
+        header_timeout = timeoutsconfigjson["header"].is_number_unsigned() ? timeoutsconfigjson["header"].get<int>() : idle_timeout;
+        write_timeout = timeoutsconfigjson["write"].is_number_unsigned() ? timeoutsconfigjson["write"].get<int>() : idle_timeout;
+    }
+    s_logger->info("[init] connection timeout: idle={}ms, header={}ms, write={}ms", idle_timeout, header_timeout, write_timeout);
     // 设置服务器的根目录
     std::string root = configJson["root"].is_string() ? configJson["root"].get<std::string>() : "www";
     s_logger->info("[init] doc root is set to {}", root);
     // 设置线程池的参数
     int tpworker = std::thread::hardware_concurrency(), tpmaxtasks = 10000;
+    std::string tpscheduler = "shared";
     if (configJson["threadpool"].is_object())
     {
-        const auto &tpconfigjson = configJson["threadpool"];
+        auto &tpconfigjson = configJson["threadpool"];
         tpworker = tpconfigjson["workers"].is_number_unsigned() ? tpconfigjson["workers"].get<int>() : std::thread::hardware_concurrency();
         tpmaxtasks = tpconfigjson["maxtask"].is_number_unsigned() ? tpconfigjson["maxtask"].get<int>() : 10000;
+        tpscheduler = tpconfigjson["scheduler"].is_string() ? tpconfigjson["scheduler"].get<std::string>() : "shared";
+    }
+    if (tpscheduler != "shared" && tpscheduler != "stealing")
+    {
+        s_logger->warn("[init] unknown thread pool scheduler {}, use shared", tpscheduler);
+        tpscheduler = "shared";
+    }
+    m_highwater = tpmaxtasks * 4 / 5;
+    if (configJson["threadpool"].is_object() && configJson["threadpool"].contains("highwater") && configJson["threadpool"]["highwater"].is_number_unsigned())
+    {
+        m_highwater = configJson["threadpool"]["highwater"].get<int>();
+    }
+    m_highwater = std::clamp(m_highwater, 1, std::max(tpmaxtasks, 1));
+    s_logger->info("[init] thread pool: workers={}, maxtask={}, highwater={}, scheduler={}", tpworker, tpmaxtasks, m_highwater, tpscheduler);
+    // 设置运行模式
+    std::string modestr = "pool";
+    int reactorcnt = std::thread::hardware_concurrency();
+    if (configJson["reactor"].is_object())
+    {
+        auto &reactorconfigjson = configJson["reactor"];
+        modestr = reactorconfigjson["mode"].is_string() ? reactorconfigjson["mode"].get<std::string>() : "pool";
+        reactorcnt = reactorconfigjson["count"].is_number_unsigned() ? reactorconfigjson["count"].get<int>() : std::thread::hardware_concurrency();
+        m_inline = reactorconfigjson["inline"].is_boolean() ? reactorconfigjson["inline"].get<bool>() : false;
+    }
+    if (modestr == "multi")
+    {
+        m_mode = Mode::MULTI_REACTOR;
+        reactorcnt = std::max(reactorcnt, 1);
+    }
+    else
+    {
+        modestr = "pool";
+        m_mode = Mode::POOL;
+        reactorcnt = 1;
     }
-    s_logger->info("[init] thread pool: workers={}, maxtask={}", tpworker, tpmaxtasks);
+    s_logger->info("[init] reactor: mode={}, count={}, inline={}", modestr, reactorcnt, m_inline);
     // 设置缓存池的参数
-    int cpmaxsize = 1073741824, cpmaxitems = 10000;
+    int cpmaxsize = 1073741824, cpmaxitems = 10000, cpshards = 16;
+    std::string cppolicy = "lru";
+    // 缓存项的重新验证间隔，以毫秒为单位，trust为true时从不验证
+    int cprevalidate = 1000;
+    bool cptrust = false;
+    // 是否使用inotify监视根目录，监视生效时不需要重新验证
+    bool cpwatch = false;
+    // 不超过这个大小（字节）的文件读入共享的分级内存池，更大的文件使用mmap，为0时全部使用mmap
+    int cpsmallfile = 16384;
+    // 不小于这个大小（字节）的文件缓存打开的文件描述符，使用sendfile发送，为0时不使用sendfile
+    int cpsendfile = 1048576;
+    // 不小于这个大小（字节）或者超过maxsize的文件不进入缓存，流式发送，为0时只流式发送超过maxsize的文件
+    int cpstream = 0;
+    // 是否根据内存中文件的内容计算ETag，否则根据修改时间和大小生成
+    bool cpetaghash = false;
+    bool cpprecompressed = false;
+    // 在后台线程中生成的压缩副本的编码，为空时不压缩；只压缩大小在compress_min和compress_max之间的文件
+    std::vector<std::string> cpcompress;
+    int cpcompressmin = 1024;
+    int cpcompressmax = 8388608;
     if (configJson["cachepool"].is_object())
     {
-        const auto &cpconfigjson = configJson["cachepool"];
+        auto &cpconfigjson = configJson["cachepool"];
         cpmaxsize = cpconfigjson["maxsize"].is_number_unsigned() ? cpconfigjson["maxsize"].get<int>() : 1073741824;
         cpmaxitems = cpconfigjson["maxitem"].is_number_unsigned() ? cpconfigjson["maxitem"].get<int>() : 10000;
+        cpshards = cpconfigjson["shards"].is_number_unsigned() ? cpconfigjson["shards"].get<int>() : 16;
+        cppolicy = cpconfigjson["policy"].is_string() ? cpconfigjson["policy"].get<std::string>() : "lru";
+        cprevalidate = cpconfigjson["revalidate_ms"].is_number_unsigned() ? cpconfigjson["revalidate_ms"].get<int>() : 1000;
+        cptrust = cpconfigjson["trust"].is_boolean() ? cpconfigjson["trust"].get<bool>() : false;
+        cpwatch = cpconfigjson["watch"].is_boolean() ? cpconfigjson["watch"].get<bool>() : false;
+        cpsmallfile = cpconfigjson["small_file"].is_number_unsigned() ? cpconfigjson["small_file"].get<int>() : 16384;
+        cpsendfile = cpconfigjson["sendfile_min"].is_number_unsigned() ? cpconfigjson["sendfile_min"].get<int>() : 1048576;
+        cpstream = cpconfigjson["stream_min"].is_number_unsigned() ? cpconfigjson["stream_min"].get<int>() : 0;
+        cpetaghash = cpconfigjson["etag_hash"].is_boolean() ? cpconfigjson["etag_hash"].get<bool>() : false;
+        cpprecompressed = cpconfigjson["precompressed"].is_boolean() ? cpconfigjson["precompressed"].get<bool>() : false;
+        if (cpconfigjson["compress"].is_array())
+        {
+            for (auto &name : cpconfigjson["compress"])
+            {
+                if (name.is_string())
+                    cpcompress.push_back(name.get<std::string>());
+            }
+        }
+        cpcompressmin = cpconfigjson["compress_min"].is_number_unsigned() ? cpconfigjson["compress_min"].get<int>() : 1024;
+        cpcompressmax = cpconfigjson["compress_max"].is_number_unsigned() ? cpconfigjson["compress_max"].get<int>() : 8388608;
+    }
+    cpshards = std::max(cpshards, 1);
+    if (!CachePolicy::create(cppolicy, 1))
+    {
+        s_logger->warn("[init] unknown cache policy {}, use lru", cppolicy);
+        cppolicy = "lru";
     }
-    s_logger->info("[init] file cache pool: maxsize={} bytes, maxitem={}", cpmaxsize, cpmaxitems);
-    // 设置时钟的参数
+    std::vector<HTTPHeaderParser::Encoding> cpencodings;
+    std::string cpcompressnames;
+    for (auto &name : cpcompress)
+    {
+        auto encoding = HTTPHeaderParser::parseAcceptEncoding(name);
+        if (encoding.size() != 1 || !Compressor::isSupported(encoding.front()))
+        {
+            s_logger->warn("[init] compression {} is not supported, ignored", name);
+            continue;
+        }
+        cpencodings.push_back(encoding.front());
+        cpcompressnames += cpcompressnames.empty() ? name : "," + name;
+    }
+    s_logger->info("[init] file cache pool: maxsize={} bytes, maxitem={}, shards={}, policy={}, revalidate={}ms, trust={}, watch={}, small_file={} bytes, sendfile_min={} bytes, stream_min={} bytes, etag_hash={}, precompressed={}, compress=[{}], compress_min={} bytes, compress_max={} bytes", cpmaxsize, cpmaxitems, cpshards, cppolicy, cprevalidate, cptrust, cpwatch, cpsmallfile, cpsendfile, cpstream, cpetaghash, cpprecompressed, cpcompressnames, cpcompressmin, cpcompressmax);
+    // 覆盖或者补充内置的MIME类型，键为后缀名（可以省略开头的点），值为Content-Type
+    std::vector<std::pair<std::string, std::string>> mimeoverrides;
+    if (configJson["mime"].is_object())
+    {
+        for (auto &[extension, type] : configJson["mime"].items())
+        {
+            if (extension.empty() || extension == "." || !type.is_string() || type.get<std::string>().empty())
+            {
+                s_logger->warn("[init] invalid mime type for {}, ignored", extension);
+                continue;
+            }
+            mimeoverrides.emplace_back(extension, type.get<std::string>());
+        }
+    }
+    s_logger->info("[init] mime: {} overrides", mimeoverrides.size());
+    // 设置时钟的参数，interval_ms优先于以秒为单位的interval
     int timergranularity = 10;
-    m_timerinterval = 1;
+    int timerinterval_ms = 1000;
     if (configJson["timer"].is_object())
     {
-        const auto &timerconfigjson = configJson["timer"];
+        auto &timerconfigjson = configJson["timer"];
         timergranularity = timerconfigjson["granularity"].is_number_unsigned() ? timerconfigjson["granularity"].get<int>() : 10;
-        m_timerinterval = timerconfigjson["interval"].is_number_unsigned() ? timerconfigjson["interval"].get<int>() : 1;
+        timerinterval_ms = timerconfigjson["interval"].is_number_unsigned() ? timerconfigjson["interval"].get<int>() * 1000 : 1000;
+        timerinterval_ms = timerconfigjson["interval_ms"].is_number_unsigned() ? timerconfigjson["interval_ms"].get<int>() : timerinterval_ms;
     }
-    s_logger->info("[init] timer: granularity={}, interval={}s", timergranularity, m_timerinterval);
+    timergranularity = std::max(timergranularity, 1);
+    timerinterval_ms = std::max(timerinterval_ms, 1);
+    s_logger->info("[init] timer: granularity={}, interval={}ms", timergranularity, timerinterval_ms);
     s_logger->info("-------------------------------");
     // 开始监听
-    m_listenfd = socket(PF_INET, SOCK_STREAM, 0);
-    struct linger tmp = {1, 0};
-    setsockopt(m_listenfd, SOL_SOCKET, SO_LINGER, &tmp, sizeof(tmp));
-    if (m_listenfd < 0)
-    {
-        s_logger->critical("[init] fail to create listen socket");
-        return false;
-    }
     m_addr.sin_family = AF_INET;
     m_addr.sin_port = htons(port);
     inet_pton(AF_INET, host.c_str(), &m_addr.sin_addr);
-    int ret = bind(m_listenfd, reinterpret_cast<sockaddr *>(&m_addr), sizeof(m_addr));
-    if (ret == -1)
+    // 创建事件循环，多反应堆模式下每个事件循环拥有独立的epoll描述符、监听socket和计时器
+    m_reactors = std::vector<Reactor>(reactorcnt);
+    for (auto &reactor : m_reactors)
     {
-        s_logger->critical("[init] fail to bind listen socket to {}", Utils::addr2str(m_addr));
-        return false;
+        reactor.listenfd = createListenSocket(m_mode == Mode::MULTI_REACTOR);
+        if (reactor.listenfd < 0)
+        {
+            return false;
+        }
+        reactor.epfd = epoll_create(MAX_EVENT_SIZE);
+        reactor.wakefd = eventfd(0, EFD_NONBLOCK);
+        reactor.epevents.resize(MAX_EVENT_SIZE);
+        reactor.timers.resize(MAX_FD_SIZE);
+        reactor.timer = std::make_shared<HashedWheelTimer>(timergranularity, std::chrono::milliseconds(timerinterval_ms));
+        // 时间轮由timerfd驱动，与其他事件在同一个epoll中处理
+        reactor.timerfd = Utils::createtimerfd(std::chrono::milliseconds(timerinterval_ms));
+        if (reactor.timerfd < 0)
+        {
+            s_logger->critical("[init] fail to create timerfd");
+            return false;
+        }
+        // 监听wakefd
+        Utils::addepfd(reactor.epfd, reactor.wakefd, EPOLLIN | EPOLLET);
+        // 监听timerfd
+        Utils::addepfd(reactor.epfd, reactor.timerfd, EPOLLIN | EPOLLET);
+        // 监听listenfd
+        Utils::addepfd(reactor.epfd, reactor.listenfd, EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLHUP);
+        Utils::setfdnonblocking(reactor.listenfd);
     }
-    ret = listen(m_listenfd, backlog);
-    if (ret == -1)
+    // 创建线程池，多反应堆模式下连接在所属的事件循环中处理，不需要线程池
+    if (m_mode == Mode::POOL)
     {
-        s_logger->critical("[init] fail to listen on {}", Utils::addr2str(m_addr));
-        return false;
+        m_tp = std::make_shared<ThreadPool>();
+        m_tp->start(tpworker, tpmaxtasks, tpscheduler == "stealing" ? ThreadPool::Scheduler::STEALING : ThreadPool::Scheduler::SHARED);
     }
-    // 创建线程池
-    m_tp = std::make_shared<ThreadPool>();
-    m_tp->start(tpworker, tpmaxtasks);
     // 创建文件缓存池
-    m_fp = std::make_shared<FileCachePool>(cpmaxsize, cpmaxitems);
-    // 创建计时器
-    m_timer = std::make_shared<HashedWheelTimer>(timergranularity, std::chrono::seconds(m_timerinterval));
+    m_fp = std::make_shared<FileCachePool>(cpmaxsize, cpmaxitems, cpshards, cppolicy, cpsmallfile, cpsendfile, cpstream);
+    m_fp->setRevalidateInterval(std::chrono::milliseconds(cprevalidate));
+    m_fp->setTrustCache(cptrust);
+    m_fp->setHashETag(cpetaghash);
+    m_fp->setPrecompressed(cpprecompressed);
+    m_fp->setCompression(cpencodings, cpcompressmin, cpcompressmax);
+    m_fp->setMimeTypes(MimeTypes(mimeoverrides));
+    // 监视根目录，文件的变化由监视器推送到缓存池，缓存命中时不再访问文件系统
+    if (cpwatch)
+    {
+        m_watcher = std::make_shared<DocRootWatcher>(m_fp, root);
+        m_watcher->setFallback([this, cptrust, cprevalidate](const std::string &reason)
+        {
+            s_logger->warn("[watcher] {}, fall back to revalidation every {}ms", reason, cprevalidate);
+            m_fp->setTrustCache(cptrust);
+        });
+        std::string reason;
+        if (m_watcher->start(reason))
+        {
+            m_fp->setTrustCache(true);
+            s_logger->info("[init] watching doc root {}", root);
+        }
+        else
+        {
+            s_logger->warn("[init] fail to watch doc root: {}, fall back to revalidation every {}ms", reason, cprevalidate);
+            m_watcher.reset();
+        }
+    }
 
     // 建立处理信号用的管道
     socketpair(PF_UNIX, SOCK_STREAM, 0, s_fd_sigpipe);
     // 将管道的写入设为非阻塞
     Utils::setfdnonblocking(s_fd_sigpipe[1]);
-    // 创建epoll描述符
-    m_epfd = epoll_create(MAX_EVENT_SIZE);
-    // 监听signal管道的读取端
-    Utils::addepfd(m_epfd, s_fd_sigpipe[0], EPOLLIN | EPOLLET);
-    // 监听listenfd
-    Utils::addepfd(m_epfd, m_listenfd, EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLHUP);
-    Utils::setfdnonblocking(m_listenfd);
+    // 由主线程的事件循环监听signal管道的读取端
+    Utils::addepfd(m_reactors[0].epfd, s_fd_sigpipe[0], EPOLLIN | EPOLLET);
 
     // 添加信号处理函数
     Utils::setsighandler(SIGINT, &sighandler);
     Utils::setsighandler(SIGTERM, &sighandler);
     Utils::setsighandler(SIGPIPE, &sighandler);
-    Utils::setsighandler(SIGALRM, &sighandler);
 
     // 给HTTP处理类设置参数
     HTTPClientTask::s_userCnt.fetch_and(0);
     HTTPClientTask::s_docRoot = root;
-    HTTPClientTask::s_epfd = m_epfd;
     HTTPClientTask::s_pool = m_fp;
     HTTPClientTask::s_client_lock = std::vector<std::mutex>(MAX_FD_SIZE);
     HTTPClientTask::s_logger = s_logger;
+    HTTPClientTask::s_idleTimeout = std::chrono::milliseconds(idle_timeout);
+    HTTPClientTask::s_headerTimeout = std::chrono::milliseconds(header_timeout);
+    HTTPClientTask::s_writeTimeout = std::chrono::milliseconds(write_timeout);
 
     return true;
 }
@@ -160,41 +310,108 @@ void StaticServer::loop()
 {
     s_logger->info("[server] listening on {}", Utils::addr2str(m_addr));
 
-    alarm(m_timerinterval);
     m_stop_server = false;
-    m_timeout_flag = false;
+    // 主线程运行第一个事件循环，多反应堆模式下其余事件循环各自运行在独立的线程中
+    for (size_t i = 1; i < m_reactors.size(); i++)
+    {
+        m_reactors[i].thread = std::thread(&StaticServer::reactorLoop, this, std::ref(m_reactors[i]));
+    }
+    reactorLoop(m_reactors[0]);
+
+    for (auto &reactor : m_reactors)
+    {
+        if (reactor.thread.joinable())
+        {
+            reactor.thread.join();
+        }
+    }
+    for (auto &reactor : m_reactors)
+    {
+        close(reactor.listenfd);
+        close(reactor.wakefd);
+        close(reactor.timerfd);
+        close(reactor.epfd);
+    }
+    close(s_fd_sigpipe[1]);
+    close(s_fd_sigpipe[0]);
+    if (m_watcher)
+    {
+        m_watcher->stop();
+    }
+}
+
+int StaticServer::createListenSocket(bool reuseport)
+{
+    int listenfd = socket(PF_INET, SOCK_STREAM, 0);
+    if (listenfd < 0)
+    {
+        s_logger->critical("[init] fail to create listen socket");
+        return -1;
+    }
+    // 连接正常关闭（不发送RST，响应不会被截断）并进入TIME_WAIT，允许重启后立即重新绑定端口
+    Utils::setreusefd(listenfd, true);
+    if (reuseport && Utils::setreuseport(listenfd, true) < 0)
+    {
+        s_logger->critical("[init] fail to set SO_REUSEPORT on listen socket");
+        close(listenfd);
+        return -1;
+    }
+    int ret = bind(listenfd, reinterpret_cast<sockaddr *>(&m_addr), sizeof(m_addr));
+    if (ret == -1)
+    {
+        s_logger->critical("[init] fail to bind listen socket to {}", Utils::addr2str(m_addr));
+        close(listenfd);
+        return -1;
+    }
+    ret = listen(listenfd, m_backlog);
+    if (ret == -1)
+    {
+        s_logger->critical("[init] fail to listen on {}", Utils::addr2str(m_addr));
+        close(listenfd);
+        return -1;
+    }
+    return listenfd;
+}
+
+void StaticServer::reactorLoop(Reactor &reactor)
+{
     while (!m_stop_server)
     {
-        int event_num = epoll_wait(m_epfd, &m_epevents[0], m_epevents.size(), -1);
+        int wait_ms = -1;
+        if (m_mode == Mode::POOL && (!m_retryTasks.empty() || m_acceptPaused))
+        {
+            // 有被推迟的任务或者连接，短暂等待后重试
+            wait_ms = OVERLOAD_RETRY_INTERVAL_MS;
+        }
+        int event_num = epoll_wait(reactor.epfd, &reactor.epevents[0], reactor.epevents.size(), wait_ms);
         for (int nr_ev = 0; nr_ev < event_num; nr_ev++)
         {
-            const auto &curr_event = m_epevents[nr_ev];
+            const auto &curr_event = reactor.epevents[nr_ev];
             int curr_fd = curr_event.data.fd;
 
-            if (curr_fd == m_listenfd)
+            if (curr_fd == reactor.listenfd)
             {
                 // 有新的传入连接
-                sockaddr_in client_addr;
-                socklen_t client_addr_len = sizeof(sockaddr_in);
-                int clientfd = -1;
-                // 循环接受连接，直到accept返回-1
-                for (;;)
+                acceptConnections(reactor);
+            }
+            else if (curr_fd == reactor.timerfd)
+            {
+                // 时间轮转动，如果事件循环被阻塞得太久，则补上错过的次数
+                uint64_t expirations = 0;
+                if (::read(reactor.timerfd, &expirations, sizeof(expirations)) == sizeof(expirations))
                 {
-                    int clientfd = accept(m_listenfd, reinterpret_cast<sockaddr *>(&client_addr), &client_addr_len);
-                    if (clientfd < 0)
+                    for (uint64_t i = 0; i < expirations; i++)
                     {
-                        s_logger->info("[server] accept return -1: {}", strerror(errno));
-                        break;
+                        reactor.timer->tick();
                     }
-                    // 添加一个任务用于初始化连接
-                    m_tp->appendTask(std::bind(&HTTPClientTask::init, &m_clients[clientfd], clientfd, client_addr));
-                    s_logger->info("[server] accept connection, socket: {}, addr: {}", clientfd, Utils::addr2str(client_addr));
-                    // 连接的超时计时器
-                    m_timers[clientfd].time_point = std::chrono::high_resolution_clock::now() + std::chrono::seconds(m_connection_timeout);
-                    m_timers[clientfd].callback = std::bind(&StaticServer::timeoutcb, this, &m_clients[clientfd]);
-                    m_timer->addTimer(&m_timers[clientfd]);
                 }
             }
+            else if (curr_fd == reactor.wakefd)
+            {
+                // 被其他线程唤醒，检查是否需要退出
+                eventfd_t val;
+                eventfd_read(reactor.wakefd, &val);
+            }
             else if (curr_fd == s_fd_sigpipe[0])
             {
                 // 有新的信号
@@ -212,10 +429,6 @@ void StaticServer::loop()
                         s_logger->info("[server] SIGTERM received, exiting");
                         m_stop_server = true;
                         break;
-                    case SIGALRM:
-                        m_timeout_flag = true;
-                        s_logger->trace("[server] SIGALRM received");
-                        break;
                     case SIGPIPE:
                         s_logger->info("[server] SIGPIPE received, do nothing");
                         break;
@@ -224,48 +437,159 @@ void StaticServer::loop()
                         break;
                     }
                 }
+                if (m_stop_server)
+                {
+                    // 唤醒其他事件循环，使其退出
+                    for (auto &other : m_reactors)
+                    {
+                        eventfd_write(other.wakefd, 1);
+                    }
+                }
             }
             else if (curr_event.events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR))
             {
-                // 连接出错，提交一个任务用于关闭连接
-                m_tp->appendTask(std::bind(&HTTPClientTask::process, &m_clients[curr_fd], HTTPClientTask::TaskContext::CLOSE));
+                // 连接出错，关闭连接
+                dispatch(curr_fd, HTTPClientTask::TaskContext::CLOSE);
                 s_logger->warn("[server] socket: {} received EPOLLRDHUP/EPOLLHUP/EPOLLERR, closing", curr_fd);
                 // 删掉socket上的定时器
-                m_timer->delTimer(&m_timers[curr_fd]);
+                reactor.timer->delTimer(&reactor.timers[curr_fd]);
             }
             else
             {
                 if (curr_event.events & EPOLLIN)
                 {
                     // 有待读取的数据
-                    m_tp->appendTask(std::bind(&HTTPClientTask::process, &m_clients[curr_fd], HTTPClientTask::TaskContext::IN));
                     s_logger->trace("[server] socket: {}, EPOLLIN", curr_fd);
+                    if (m_clients[curr_fd].getPhase() == HTTPClientTask::Phase::IDLE)
+                    {
+                        // 新的请求开始，使用接收请求头的超时时间，同一个请求后续的数据不会延长这个时间
+                        reactor.timers[curr_fd].time_point = std::chrono::high_resolution_clock::now() + HTTPClientTask::s_headerTimeout;
+                        reactor.timer->addTimer(&reactor.timers[curr_fd]);
+                    }
+                    if (m_mode == Mode::POOL && isOverloaded())
+                    {
+                        // 任务队列超过高水位，内联模式下仍然直接处理缓存命中的请求，其余请求直接拒绝
+                        // 流水线中已经生成的响应由processInline发送，503排在它们之后，只有还没有任何响应时才由shed丢弃数据并拒绝
+                        auto next_context = m_inline ? m_clients[curr_fd].processInline(true) : HTTPClientTask::TaskContext::IN;
+                        if (next_context)
+                        {
+                            shed(reactor, curr_fd);
+                            continue;
+                        }
+                    }
+                    else
+                    {
+                        dispatch(curr_fd, HTTPClientTask::TaskContext::IN);
+                    }
                 }
                 else if (curr_event.events & EPOLLOUT)
                 {
                     // socket上的可写任务
-                    m_tp->appendTask(std::bind(&HTTPClientTask::process, &m_clients[curr_fd], HTTPClientTask::TaskContext::OUT));
+                    dispatch(curr_fd, HTTPClientTask::TaskContext::OUT);
                     s_logger->trace("[server] socket: {}, EPOLLOUT", curr_fd);
                 }
-                // 更新socket上的定时器
-                m_timers[curr_fd].time_point = std::chrono::high_resolution_clock::now() + std::chrono::seconds(m_connection_timeout);
-                m_timers[curr_fd].callback = std::bind(&StaticServer::timeoutcb, this, &m_clients[curr_fd]);
-                m_timer->delTimer(&m_timers[curr_fd]);
-                m_timer->addTimer(&m_timers[curr_fd]);
+                // 写入和空闲阶段的超时由连接记录的最后活动时间决定，在计时器到期时检查，这里不需要更新计时器
             }
         }
-        if (m_timeout_flag)
+        if (m_mode == Mode::POOL)
         {
-            m_timer->tick();
-            alarm(m_timerinterval);
-            m_timeout_flag = false;
+            retryDeferred(reactor);
         }
     }
+}
 
-    close(m_listenfd);
-    close(s_fd_sigpipe[1]);
-    close(s_fd_sigpipe[0]);
-    close(m_epfd);
+void StaticServer::acceptConnections(Reactor &reactor)
+{
+    sockaddr_in client_addr;
+    socklen_t client_addr_len = sizeof(sockaddr_in);
+    // 循环接受连接，直到accept返回-1
+    for (;;)
+    {
+        if (m_mode == Mode::POOL && isOverloaded())
+        {
+            // 任务队列超过高水位，暂停接受连接，新连接留在内核的等待队列中
+            // 由于监听socket使用ET模式，恢复时需要主动调用accept
+            if (!m_acceptPaused)
+                s_logger->warn("[server] task queue above high water mark, accept paused");
+            m_acceptPaused = true;
+            break;
+        }
+        int clientfd = accept(reactor.listenfd, reinterpret_cast<sockaddr *>(&client_addr), &client_addr_len);
+        if (clientfd < 0)
+        {
+            s_logger->info("[server] accept return -1: {}", strerror(errno));
+            break;
+        }
+        // 连接在接受它的事件循环中初始化并注册，保证之后的事件一定能找到已经注册的连接
+        m_clients[clientfd].init(clientfd, client_addr, reactor.epfd);
+        s_logger->info("[server] accept connection, socket: {}, addr: {}", clientfd, Utils::addr2str(client_addr));
+        // 连接的超时计时器
+        reactor.timers[clientfd].time_point = std::chrono::high_resolution_clock::now() + HTTPClientTask::s_idleTimeout;
+        reactor.timers[clientfd].callback = std::bind(&StaticServer::timeoutcb, this, &reactor, clientfd);
+        reactor.timer->addTimer(&reactor.timers[clientfd]);
+    }
+}
+
+bool StaticServer::isOverloaded()
+{
+    return m_tp->getTaskCount() >= m_highwater;
+}
+
+void StaticServer::shed(Reactor &reactor, int fd)
+{
+    if (m_clients[fd].reject())
+    {
+        reactor.timer->delTimer(&reactor.timers[fd]);
+    }
+    else
+    {
+        // 连接正在被工作线程处理，稍后重试
+        m_retryTasks.emplace_back(fd, m_clients[fd].makeTask(HTTPClientTask::TaskContext::IN));
+    }
+}
+
+void StaticServer::retryDeferred(Reactor &reactor)
+{
+    // 重新提交被推迟的任务，任务队列仍然已满时保留剩余的任务，保证已经触发的事件不会丢失
+    while (!m_retryTasks.empty())
+    {
+        auto &[fd, task] = m_retryTasks.front();
+        if (!m_tp->appendTask(task, fd))
+            break;
+        m_retryTasks.pop_front();
+    }
+    // 负载降到高水位的一半以下后恢复接受连接
+    if (m_acceptPaused && m_tp->getTaskCount() < m_highwater / 2 + 1)
+    {
+        s_logger->warn("[server] task queue drained, accept resumed");
+        m_acceptPaused = false;
+        acceptConnections(reactor);
+    }
+}
+
+void StaticServer::dispatch(int fd, HTTPClientTask::TaskContext context)
+{
+    if (m_mode == Mode::MULTI_REACTOR)
+    {
+        m_clients[fd].process(context);
+        return;
+    }
+    if (m_inline && context == HTTPClientTask::TaskContext::IN)
+    {
+        // 缓存命中的请求直接在事件循环中完成，只有可能阻塞的部分交给线程池
+        auto next_context = m_clients[fd].processInline();
+        if (!next_context)
+            return;
+        context = next_context.value();
+    }
+    // 以fd作为affinity，同一个连接上的事件优先由同一个工作线程处理
+    auto task = m_clients[fd].makeTask(context);
+    if (!m_tp->appendTask(task, fd))
+    {
+        // 任务队列已满，由于socket注册了EPOLLONESHOT，丢弃任务会导致连接永远不会被重新注册，所以放入重试队列
+        s_logger->warn("[server] socket: {}, task queue full, task deferred", fd);
+        m_retryTasks.emplace_back(fd, task);
+    }
 }
 
 void StaticServer::sighandler(int sig)
@@ -278,8 +602,22 @@ void StaticServer::sighandler(int sig)
     errno = errno_org;
 }
 
-void StaticServer::timeoutcb(HTTPClientTask *client)
+void StaticServer::timeoutcb(Reactor *reactor, int fd)
 {
-    m_tp->appendTask(std::bind(&HTTPClientTask::process, client, HTTPClientTask::TaskContext::CLOSE));
-    s_logger->info("timeout callback triggered");
+    auto &client = m_clients[fd];
+    // 连接已经关闭，或者fd已经被其他事件循环上的新连接使用
+    if (client.getEpfd() != reactor->epfd)
+        return;
+    auto deadline = client.getDeadline();
+    if (!deadline)
+        return;
+    if (deadline.value() > std::chrono::high_resolution_clock::now())
+    {
+        // 连接在计时器添加之后有过活动，或者进入了新的阶段，按照新的超时时间重新添加
+        reactor->timers[fd].time_point = deadline.value();
+        reactor->timer->addTimer(&reactor->timers[fd]);
+        return;
+    }
+    s_logger->info("[server] socket: {} timeout in phase {}, closing", fd, static_cast<int>(client.getPhase()));
+    dispatch(fd, HTTPClientTask::TaskContext::CLOSE);
 }
@@ -1,7 +1,9 @@
 #include "threadpool.h"
 
+#include <algorithm>
+
 ThreadPool::ThreadPool()
-    : m_queueStatus {0}, m_stopFlag(true)
+    : m_stopFlag(true)
 {
 }
 
@@ -10,45 +12,181 @@ ThreadPool::~ThreadPool()
     stop();
 }
 
-void ThreadPool::start(int nr_threads, int nr_max_task)
+void ThreadPool::start(int nr_threads, int nr_max_task, Scheduler scheduler)
 {
     if (!m_stopFlag)
     {
         return;
     }
     m_stopFlag = false;
-    m_nrMaxTask = nr_max_task;
+    m_scheduler = scheduler;
+    // STEALING模式下把总长度平均分给每个工作线程的队列
+    size_t nr_queue = scheduler == Scheduler::STEALING ? std::max(nr_threads, 1) : 1;
+    for (size_t i = 0; i < nr_queue; i++)
+    {
+        size_t capacity = nr_max_task / nr_queue + (i < nr_max_task % nr_queue ? 1 : 0);
+        m_taskQueues.push_back(std::make_unique<MPMCQueue<Task>>(std::max<size_t>(capacity, 1)));
+    }
+    for (int i = 0; i < nr_threads; i++)
+    {
+        m_workers.push_back(std::make_unique<Worker>());
+    }
     for (int i = 0; i < nr_threads; i++)
     {
-        m_threads.emplace_back(std::bind(&ThreadPool::loop, this));
+        m_threads.emplace_back(std::bind(&ThreadPool::loop, this, i));
     }
 }
 
 void ThreadPool::wait()
 {
-    for (;;)
+    while (m_unfinished.load() > 0)
     {
-        std::scoped_lock locker(m_taskQueueMutex);
-        if (m_taskQueue.empty())
+        std::this_thread::yield();
+    }
+}
+
+bool ThreadPool::appendTask(const Task &task)
+{
+    return appendTask(task, m_roundRobin.fetch_add(1, std::memory_order_relaxed));
+}
+
+bool ThreadPool::appendTask(const Task &task, size_t affinity)
+{
+    if (m_taskQueues.empty())
+    {
+        return false;
+    }
+    // 先增加计数，保证任务完成时的减法不会早于加法
+    m_unfinished.fetch_add(1);
+    // 首先放入affinity对应的队列，队列已满时依次放入后面的队列
+    size_t nr_queue = m_taskQueues.size();
+    size_t home = affinity % nr_queue;
+    for (size_t i = 0; i < nr_queue; i++)
+    {
+        size_t index = (home + i) % nr_queue;
+        if (m_taskQueues[index]->push(task))
         {
-            break;
+            notify(index);
+            return true;
         }
     }
+    m_unfinished.fetch_sub(1);
+    return false;
 }
 
 bool ThreadPool::appendTask(std::function<void()> task)
 {
-    // 获取任务队列的锁 RAII
-    std::scoped_lock locker(m_taskQueueMutex);
-    if (m_taskQueue.size() >= m_nrMaxTask)
+    auto closure = new std::function<void()>(std::move(task));
+    if (!appendTask(Task{&ThreadPool::runClosure, closure, 0, 0}))
     {
+        delete closure;
         return false;
     }
-    m_taskQueue.push(std::move(task));
-    m_queueStatus.release();
     return true;
 }
 
+void ThreadPool::runClosure(void *obj, int, uint32_t)
+{
+    std::unique_ptr<std::function<void()>> closure(static_cast<std::function<void()> *>(obj));
+    (*closure)();
+}
+
+int ThreadPool::getTaskCount()
+{
+    size_t count = 0;
+    for (auto &queue : m_taskQueues)
+    {
+        count += queue->size();
+    }
+    return count;
+}
+
+bool ThreadPool::wake(size_t id)
+{
+    auto &worker = *m_workers[id];
+    if (!worker.sleeping.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+    worker.wakeup.fetch_add(1, std::memory_order_release);
+    worker.wakeup.notify_one();
+    return true;
+}
+
+void ThreadPool::notify(size_t index)
+{
+    // 与take中的fence配对：要么生产者看到休眠的线程，要么工作线程在休眠前看到新的任务
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleepers.load(std::memory_order_relaxed) == 0)
+    {
+        return;
+    }
+    if (m_scheduler == Scheduler::STEALING)
+    {
+        // 优先唤醒任务所属的工作线程；它正忙并且队列中已经有积压的任务时，唤醒其他线程来窃取
+        if (wake(index) || m_taskQueues[index]->size() <= 1)
+        {
+            return;
+        }
+    }
+    for (size_t id = 0; id < m_workers.size(); id++)
+    {
+        if (wake(id))
+        {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::pop(size_t id, Task &task)
+{
+    size_t nr_queue = m_taskQueues.size();
+    size_t home = id % nr_queue;
+    for (size_t i = 0; i < nr_queue; i++)
+    {
+        if (m_taskQueues[(home + i) % nr_queue]->pop(task))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::take(size_t id, Task &task)
+{
+    auto &worker = *m_workers[id];
+    for (;;)
+    {
+        // 先自旋一段时间，任务密集时避免进入内核
+        for (int i = 0; i < SPIN_COUNT; i++)
+        {
+            if (pop(id, task))
+                return true;
+            if (m_stopFlag)
+                return false;
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#else
+            std::this_thread::yield();
+#endif
+        }
+        // 休眠之前再检查一次队列，防止错过休眠期间添加的任务
+        uint32_t wakeup = worker.wakeup.load(std::memory_order_acquire);
+        worker.sleeping.store(true, std::memory_order_relaxed);
+        m_sleepers.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool got = pop(id, task);
+        if (!got && !m_stopFlag)
+        {
+            worker.wakeup.wait(wakeup, std::memory_order_acquire);
+        }
+        m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+        worker.sleeping.store(false, std::memory_order_relaxed);
+        if (got)
+            return true;
+    }
+}
+
 void ThreadPool::stop()
 {
     // 设置停止标志
@@ -57,41 +195,42 @@ void ThreadPool::stop()
         return;
     }
     m_stopFlag = true;
-    // 信号量+N，确保唤醒所有线程并终止
-    m_queueStatus.release(m_threads.size());
+    // 唤醒所有线程并终止
+    for (auto &worker : m_workers)
+    {
+        worker->wakeup.fetch_add(1);
+        worker->wakeup.notify_all();
+    }
     // 回收所有线程
     for (auto& t: m_threads)
     {
         t.join();
     }
     m_threads.clear();
-    // 清空任务队列
-    while (!m_taskQueue.empty())
+    m_workers.clear();
+    // 清空任务队列，释放未执行的通用任务
+    for (auto &queue : m_taskQueues)
     {
-        m_taskQueue.pop();
+        Task task;
+        while (queue->pop(task))
+        {
+            if (task.handler == &ThreadPool::runClosure)
+            {
+                delete static_cast<std::function<void()> *>(task.obj);
+            }
+        }
     }
-    // 重置信号量
-    m_queueStatus.~counting_semaphore();
-    new (&m_queueStatus) std::counting_semaphore<INT_MAX> {0};
+    m_taskQueues.clear();
+    m_unfinished = 0;
 }
 
-void ThreadPool::loop()
+void ThreadPool::loop(size_t id)
 {
-    while (!m_stopFlag)
+    Task curr_task;
+    while (take(id, curr_task))
     {
-        // 信号量-1
-        m_queueStatus.acquire();
-        std::function<void()> curr_task;
-        {
-            std::scoped_lock locker(m_taskQueueMutex);
-            if (m_taskQueue.empty())
-            {
-                continue;
-            }
-            curr_task = m_taskQueue.front();
-            m_taskQueue.pop();
-        }
         // 处理任务
-        curr_task();
+        curr_task.handler(curr_task.obj, curr_task.arg, curr_task.generation);
+        m_unfinished.fetch_sub(1);
     }
 }
@@ -33,11 +33,33 @@ namespace Utils
         return ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR,
                &optval, sizeof(optval));
     }
+    int setreuseport(int fd, bool on)
+    {
+        int optval = on ? 1 : 0;
+        return ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT,
+               &optval, sizeof(optval));
+    }
     int setsighandler(int sig, sighandler_t handler)
     {
         signal(sig, handler);
         return 0;
     }
+    int createtimerfd(std::chrono::milliseconds interval)
+    {
+        int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (fd < 0)
+            return -1;
+        itimerspec spec;
+        spec.it_interval.tv_sec = interval.count() / 1000;
+        spec.it_interval.tv_nsec = (interval.count() % 1000) * 1000000;
+        spec.it_value = spec.it_interval;
+        if (timerfd_settime(fd, 0, &spec, nullptr) < 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
     std::string addr2str(sockaddr_in& addr)
     {
         char buf[32];
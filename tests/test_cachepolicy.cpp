@@ -0,0 +1,171 @@
+#include <catch2/catch_all.hpp>
+#include "cachepolicy.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+    struct TestEntry : CacheNode
+    {
+        int key;
+    };
+
+    // 容量为capacity个缓存项的模拟缓存，返回每次访问是否命中
+    class TestCache
+    {
+    public:
+        TestCache(const std::string &policy, size_t capacity)
+            : m_policy(CachePolicy::create(policy, capacity)), m_capacity(capacity)
+        {
+        }
+
+        bool access(int key)
+        {
+            uint64_t hash = std::hash<int>{}(key) * 0x9e3779b97f4a7c15ULL;
+            auto it = m_cache.find(key);
+            if (it != m_cache.end())
+            {
+                m_policy->onHit(&it->second);
+                return true;
+            }
+            m_policy->onMiss(hash);
+            auto &entry = m_cache[key];
+            entry.key = key;
+            entry.hash = hash;
+            m_policy->onInsert(&entry);
+            while (m_cache.size() > m_capacity)
+            {
+                auto victim = static_cast<TestEntry *>(m_policy->victim());
+                bool rejected = victim == &entry;
+                m_policy->onRemove(victim);
+                m_cache.erase(m_cache.find(victim->key));
+                if (rejected)
+                    break;
+            }
+            return false;
+        }
+
+        bool contains(int key) const
+        {
+            return m_cache.count(key);
+        }
+
+        size_t size() const
+        {
+            return m_cache.size();
+        }
+
+    private:
+        std::unique_ptr<CachePolicy> m_policy;
+        size_t m_capacity;
+        std::unordered_map<int, TestEntry> m_cache;
+    };
+
+    // 反复访问100个热点key，然后扫描2000个只访问一次的key，返回扫描之后仍然在缓存中的热点key数量
+    int hotAfterScan(const std::string &policy)
+    {
+        TestCache cache(policy, 200);
+        for (int round = 0; round < 20; round++)
+        {
+            for (int key = 0; key < 100; key++)
+            {
+                cache.access(key);
+            }
+        }
+        for (int key = 1000; key < 3000; key++)
+        {
+            cache.access(key);
+        }
+        REQUIRE(cache.size() <= 200);
+        int hot = 0;
+        for (int key = 0; key < 100; key++)
+        {
+            hot += cache.contains(key);
+        }
+        return hot;
+    }
+}
+
+TEST_CASE("Cache Policy", "[create]")
+{
+    REQUIRE(CachePolicy::create("lru", 10));
+    REQUIRE(CachePolicy::create("tinylfu", 10));
+    REQUIRE(CachePolicy::create("s3fifo", 10));
+    REQUIRE(!CachePolicy::create("random", 10));
+}
+
+TEST_CASE("Cache Policy", "[lru order]")
+{
+    TestCache cache("lru", 3);
+    cache.access(1);
+    cache.access(2);
+    cache.access(3);
+    // 1成为最新的项，淘汰2
+    REQUIRE(cache.access(1) == true);
+    REQUIRE(cache.access(4) == false);
+    REQUIRE(cache.contains(1));
+    REQUIRE(!cache.contains(2));
+    REQUIRE(cache.contains(3));
+}
+
+TEST_CASE("Cache Policy", "[scan resistance]")
+{
+    // 扫描会冲掉LRU中的全部热点数据
+    REQUIRE(hotAfterScan("lru") == 0);
+    // W-TinyLFU和S3-FIFO能保留绝大部分热点数据
+    REQUIRE(hotAfterScan("tinylfu") >= 90);
+    REQUIRE(hotAfterScan("s3fifo") >= 90);
+}
+
+TEST_CASE("Cache Policy", "[s3fifo ghost]")
+{
+    S3FIFOPolicy policy;
+    CacheNode m1, m2, a, b;
+    m1.hash = 1;
+    m2.hash = 2;
+    a.hash = 3;
+    b.hash = 4;
+    auto evict = [&policy]() {
+        auto victim = policy.victim();
+        policy.onRemove(victim);
+        return victim;
+    };
+    // m1和m2被再次访问过，进入主队列；a被淘汰并进入幽灵队列
+    policy.onInsert(&m1);
+    policy.onInsert(&m2);
+    policy.onHit(&m1);
+    policy.onHit(&m2);
+    policy.onInsert(&a);
+    REQUIRE(evict() == &a);
+    // 幽灵队列中的a再次插入时直接进入主队列，然后被删除
+    policy.onInsert(&a);
+    REQUIRE(a.queue != 0);
+    policy.onRemove(&a);
+    // a第二次进入幽灵队列，第一次的旧记录先于b的记录出队，不能带走a
+    policy.onInsert(&a);
+    policy.onInsert(&b);
+    REQUIRE(evict() == &a);
+    REQUIRE(evict() == &b);
+    policy.onInsert(&a);
+    REQUIRE(a.queue != 0);
+}
+
+TEST_CASE("Cache Policy", "[frequency sketch]")
+{
+    FrequencySketch sketch(64);
+    for (int i = 0; i < 10; i++)
+    {
+        sketch.increment(1);
+    }
+    sketch.increment(2);
+    REQUIRE(sketch.frequency(1) == 10);
+    REQUIRE(sketch.frequency(2) >= 1);
+    REQUIRE(sketch.frequency(2) < sketch.frequency(1));
+    // 计数器最大为15
+    for (int i = 0; i < 100; i++)
+    {
+        sketch.increment(3);
+    }
+    REQUIRE(sketch.frequency(3) <= 15);
+}
@@ -0,0 +1,69 @@
+#include <catch2/catch_all.hpp>
+#include "compressor.h"
+#include <string>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+static std::string sample_text()
+{
+    std::string text;
+    for (int i = 0; i < 2000; i++)
+    {
+        text += "<li class=\"item\">item " + std::to_string(i) + "</li>\n";
+    }
+    return text;
+}
+
+TEST_CASE("Compressor", "[unsupported]")
+{
+    // brotli只支持预压缩文件
+    REQUIRE(!Compressor::isSupported(HTTPHeaderParser::Encoding::BR));
+    REQUIRE(!Compressor::compress(HTTPHeaderParser::Encoding::BR, "a", 1));
+}
+
+#ifdef HAVE_ZLIB
+TEST_CASE("Compressor", "[gzip]")
+{
+    auto text = sample_text();
+    REQUIRE(Compressor::isSupported(HTTPHeaderParser::Encoding::GZIP));
+    auto compressed = Compressor::compress(HTTPHeaderParser::Encoding::GZIP, text.data(), text.size());
+    REQUIRE(compressed);
+    REQUIRE(compressed->size() * 4 < text.size());
+    // gzip格式的魔数
+    REQUIRE(static_cast<unsigned char>((*compressed)[0]) == 0x1f);
+    REQUIRE(static_cast<unsigned char>((*compressed)[1]) == 0x8b);
+
+    z_stream stream = {};
+    REQUIRE(inflateInit2(&stream, 15 + 16) == Z_OK);
+    std::string out(text.size() + 1, '\0');
+    stream.next_in = reinterpret_cast<unsigned char *>(compressed->data());
+    stream.avail_in = compressed->size();
+    stream.next_out = reinterpret_cast<unsigned char *>(out.data());
+    stream.avail_out = out.size();
+    REQUIRE(inflate(&stream, Z_FINISH) == Z_STREAM_END);
+    out.resize(stream.total_out);
+    inflateEnd(&stream);
+    REQUIRE(out == text);
+
+    // 空数据也是合法的gzip流
+    REQUIRE(Compressor::compress(HTTPHeaderParser::Encoding::GZIP, "", 0));
+}
+#endif
+
+#ifdef HAVE_ZSTD
+TEST_CASE("Compressor", "[zstd]")
+{
+    auto text = sample_text();
+    auto compressed = Compressor::compress(HTTPHeaderParser::Encoding::ZSTD, text.data(), text.size());
+    REQUIRE(compressed);
+    REQUIRE(compressed->size() * 4 < text.size());
+    std::string out(text.size(), '\0');
+    REQUIRE(ZSTD_decompress(out.data(), out.size(), compressed->data(), compressed->size()) == text.size());
+    REQUIRE(out == text);
+}
+#endif
@@ -0,0 +1,90 @@
+#include <catch2/catch_all.hpp>
+#include "docrootwatcher.h"
+#include "test_utils.h"
+#include <chrono>
+#include <thread>
+
+namespace
+{
+    // wait until the watcher thread has processed the events
+    template <typename Pred>
+    bool waitFor(Pred pred)
+    {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (!pred() && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return pred();
+    }
+}
+
+TEST_CASE("Doc Root Watcher", "[invalidate]")
+{
+    auto pool = std::make_shared<FileCachePool>(102400, 10);
+    // without the watcher a trusted cache never sees changes
+    pool->setTrustCache(true);
+    create_test_dir();
+    auto path1 = create_test_file(1024, "test1");
+    auto path2 = create_test_file(512, "test2");
+
+    DocRootWatcher watcher(pool, "test_dir");
+    std::string reason;
+    REQUIRE(watcher.start(reason));
+    REQUIRE(watcher.isWatching());
+
+    REQUIRE(pool->getFile(path1)->getStat()->st_size == 1024);
+    REQUIRE(pool->getFile(path2)->getStat()->st_size == 512);
+    REQUIRE(pool->getCurrentItemCount() == 2);
+
+    // modified file
+    create_test_file(2048, "test1");
+    REQUIRE(waitFor([&]() { return !pool->peekFile(path1); }));
+    REQUIRE(pool->getFile(path1)->getStat()->st_size == 2048);
+
+    // deleted file
+    remove(path2.c_str());
+    REQUIRE(waitFor([&]() { return !pool->peekFile(path2); }));
+    REQUIRE(!pool->getFile(path2));
+
+    watcher.stop();
+    REQUIRE(!watcher.isWatching());
+    remove_test_dir();
+}
+
+TEST_CASE("Doc Root Watcher", "[new directory]")
+{
+    auto pool = std::make_shared<FileCachePool>(102400, 10);
+    pool->setTrustCache(true);
+    create_test_dir();
+
+    DocRootWatcher watcher(pool, "test_dir");
+    std::string reason;
+    REQUIRE(watcher.start(reason));
+
+    // a directory created after start is watched as well
+    REQUIRE(system("mkdir -p test_dir/sub") == 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto path = create_test_file(1024, "sub/test1");
+    REQUIRE(pool->getFile(path)->getStat()->st_size == 1024);
+    create_test_file(2048, "sub/test1");
+    REQUIRE(waitFor([&]() { return !pool->peekFile(path); }));
+
+    // removing the directory drops everything below it
+    REQUIRE(pool->getFile(path)->getStat()->st_size == 2048);
+    REQUIRE(system("rm -rf test_dir/sub") == 0);
+    REQUIRE(waitFor([&]() { return pool->getCurrentItemCount() == 0; }));
+
+    watcher.stop();
+    remove_test_dir();
+}
+
+TEST_CASE("Doc Root Watcher", "[invalid root]")
+{
+    auto pool = std::make_shared<FileCachePool>(102400, 10);
+    DocRootWatcher watcher(pool, "some_random_dir");
+    std::string reason;
+    REQUIRE(!watcher.start(reason));
+    REQUIRE(!reason.empty());
+    REQUIRE(!watcher.isWatching());
+}
@@ -1,6 +1,8 @@
 #include <catch2/catch_all.hpp>
 #include "filecachepool.h"
 #include "test_utils.h"
+#include <chrono>
+#include <thread>
 
 TEST_CASE("File Cache Pool", "[basic]")
 {
@@ -110,4 +112,473 @@ TEST_CASE("File Cache Pool", "[consistency]")
     }
 
     remove_test_dir();
-}
\ No newline at end of file
+}
+TEST_CASE("File Cache Pool", "[shards]")
+{
+    // create a 4KB pool with 4 shards
+    FileCachePool pool(4096, 6, 4);
+    create_test_dir();
+
+    std::vector<std::string> file_paths;
+    for (int i = 0; i < 20; i++)
+    {
+        file_paths.push_back(create_test_file(512, "test" + std::to_string(i)));
+    }
+    for (auto &path : file_paths)
+    {
+        auto file = pool.getFile(path);
+        REQUIRE(file);
+        REQUIRE(file->getStat()->st_size == 512);
+        // the limits are enforced across all shards
+        REQUIRE(pool.getCurrentItemCount() <= 6);
+        REQUIRE(pool.getCurrentSize() <= 4096);
+    }
+    REQUIRE(pool.getCurrentItemCount() > 0);
+
+    remove_test_dir();
+}
+
+TEST_CASE("File Cache Pool", "[.][benchmark]")
+{
+    // hit cost should stay flat as the number of cached items grows
+    create_test_dir();
+    std::vector<std::string> file_paths;
+    // every cached file is a separate mapping, stay below the default vm.max_map_count
+    for (int i = 0; i < 32768; i++)
+    {
+        file_paths.push_back(create_test_file(1, "bench" + std::to_string(i)));
+    }
+
+    for (int count : { 1024, 8192, 32768 })
+    {
+        FileCachePool pool(1LL << 30, count);
+        for (int i = 0; i < count; i++)
+        {
+            pool.getFile(file_paths[i]);
+        }
+        // touch every file once so the following hits skip the first-access atime update
+        for (int i = 0; i < count; i++)
+        {
+            pool.getFile(file_paths[i]);
+        }
+        REQUIRE(pool.getCurrentItemCount() == count);
+
+        size_t idx = 0;
+        BENCHMARK("cache hit with " + std::to_string(count) + " items")
+        {
+            // walk the cached files in LRU order so every hit promotes the tail
+            auto file = pool.getFile(file_paths[idx]);
+            idx = (idx + 1) % count;
+            return file;
+        };
+    }
+
+    remove_test_dir();
+}
+
+TEST_CASE("File Cache Pool", "[policy]")
+{
+    create_test_dir();
+    std::vector<std::string> file_paths;
+    for (int i = 0; i < 20; i++)
+    {
+        file_paths.push_back(create_test_file(512, "test" + std::to_string(i)));
+    }
+    for (auto policy : { "lru", "tinylfu", "s3fifo", "unknown" })
+    {
+        FileCachePool pool(4096, 6, 2, policy);
+        for (int round = 0; round < 3; round++)
+        {
+            for (auto &path : file_paths)
+            {
+                auto file = pool.getFile(path);
+                // a rejected file is still returned to the caller
+                REQUIRE(file);
+                REQUIRE(pool.getCurrentItemCount() <= 7);
+                REQUIRE(pool.getCurrentSize() <= 4096 + 512);
+            }
+        }
+    }
+    remove_test_dir();
+}
+
+TEST_CASE("File Cache Pool", "[revalidate interval]")
+{
+    FileCachePool pool(102400, 10);
+    pool.setRevalidateInterval(std::chrono::milliseconds(200));
+    create_test_dir();
+
+    auto path = create_test_file(1024, "test1");
+    REQUIRE(pool.getFile(path)->getStat()->st_size == 1024);
+    // the change is not seen until the entry is due for revalidation
+    create_test_file(2048, "test1");
+    REQUIRE(pool.getFile(path)->getStat()->st_size == 1024);
+    REQUIRE(pool.peekFile(path));
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    REQUIRE(!pool.peekFile(path));
+    REQUIRE(pool.getFile(path)->getStat()->st_size == 2048);
+    REQUIRE(pool.getCurrentSize() == 2048);
+
+    // peekFile never stats: an entry due for revalidation is left to getFile even if the file is unchanged
+    pool.setRevalidateInterval(std::chrono::milliseconds(0));
+    REQUIRE(!pool.peekFile(path));
+    REQUIRE(pool.getCurrentItemCount() == 1);
+    REQUIRE(pool.getFile(path)->getStat()->st_size == 2048);
+
+    remove_test_dir();
+}
+
+TEST_CASE("File Cache Pool", "[trust cache]")
+{
+    FileCachePool pool(102400, 10);
+    pool.setTrustCache(true);
+    create_test_dir();
+
+    auto path = create_test_file(1024, "test1");
+    REQUIRE(pool.getFile(path)->getStat()->st_size == 1024);
+    create_test_file(2048, "test1");
+    REQUIRE(pool.getFile(path)->getStat()->st_size == 1024);
+    // revalidate again once trust is turned off
+    pool.setTrustCache(false);
+    REQUIRE(pool.getFile(path)->getStat()->st_size == 2048);
+
+    remove_test_dir();
+}
+
+TEST_CASE("File Cache Pool", "[single flight]")
+{
+    FileCachePool pool(1024 * 1024 * 64, 10);
+    create_test_dir();
+    auto path = create_test_file(1024 * 1024 * 16, "test1");
+
+    // concurrent misses on the same file share one load and all see the same item
+    std::vector<std::shared_ptr<FileCacheItem>> results(8);
+    std::vector<std::thread> threads;
+    for (auto &result : results)
+    {
+        threads.emplace_back([&pool, &path, &result]() { result = pool.getFile(path); });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    for (auto &result : results)
+    {
+        REQUIRE(result);
+        REQUIRE(result == results[0]);
+    }
+    REQUIRE(pool.getCurrentItemCount() == 1);
+
+    // failed loads are not cached
+    REQUIRE(!pool.getFile("test_dir/not_exist"));
+    REQUIRE(pool.getCurrentItemCount() == 1);
+
+    remove_test_dir();
+}
+
+TEST_CASE("File Cache Pool", "[resident size]")
+{
+    FileCachePool pool(1024 * 1024, 10, 1, "lru", 16384);
+    create_test_dir();
+
+    // small files are read into the arena and count their block size
+    auto small = create_test_file(100, "small");
+    auto item = pool.getFile(small);
+    REQUIRE(item->getStat()->st_size == 100);
+    REQUIRE(item->getResidentSize() == 112);
+    REQUIRE(pool.getCurrentSize() == 112);
+
+    // large files are mmapped and count whole pages
+    off_t page = sysconf(_SC_PAGESIZE);
+    auto large = create_test_file(16385, "large");
+    REQUIRE(pool.getFile(large)->getResidentSize() == (16385 + page - 1) / page * page);
+    // only arena blocks are known to be in memory, mmapped pages may have to be read from disk
+    REQUIRE(item->isInMemory());
+    REQUIRE(!pool.getFile(large)->isInMemory());
+    REQUIRE(pool.getCurrentSize() == 112 + (16385 + page - 1) / page * page);
+
+    // the content is the same either way
+    std::string content(5000, 'x');
+    {
+        std::ofstream out("test_dir/content");
+        out << content;
+    }
+    auto file = pool.getFile("test_dir/content");
+    REQUIRE(std::string(static_cast<const char *>(file->getData()), file->getStat()->st_size) == content);
+    FileCachePool mmap_pool(1024 * 1024, 10, 1, "lru", 0);
+    file = mmap_pool.getFile("test_dir/content");
+    REQUIRE(file->getResidentSize() == (5000 + page - 1) / page * page);
+    REQUIRE(std::string(static_cast<const char *>(file->getData()), file->getStat()->st_size) == content);
+
+    // items keep the arena alive after the pool is gone
+    std::shared_ptr<FileCacheItem> survivor;
+    {
+        FileCachePool scoped(1024 * 1024, 10);
+        survivor = scoped.getFile("test_dir/content");
+    }
+    REQUIRE(std::string(static_cast<const char *>(survivor->getData()), survivor->getStat()->st_size) == content);
+
+    remove_test_dir();
+}
+
+TEST_CASE("File Cache Pool", "[sendfile]")
+{
+    FileCachePool pool(1024 * 1024 * 64, 10, 1, "lru", 16384, 64 * 1024);
+    create_test_dir();
+
+    // large files keep an open fd and hold no memory of their own
+    auto large = create_test_file(1024 * 1024 * 4, "large");
+    auto item = pool.getFile(large);
+    REQUIRE(item);
+    REQUIRE(item->getFd() >= 0);
+    REQUIRE(!item->getData());
+    REQUIRE(item->getResidentSize() == 0);
+    REQUIRE(pool.getCurrentItemCount() == 1);
+    REQUIRE(pool.getCurrentSize() == 0);
+
+    // files below the threshold stay in memory
+    auto medium = create_test_file(64 * 1024 - 1, "medium");
+    item = pool.getFile(medium);
+    REQUIRE(item->getFd() == -1);
+    REQUIRE(item->getData());
+
+    // the fd is read with sendfile
+    std::string content(100000, 'y');
+    {
+        std::ofstream out("test_dir/content");
+        out << content;
+    }
+    item = pool.getFile("test_dir/content");
+    REQUIRE(item->getFd() >= 0);
+    std::string read_back(content.size(), '\0');
+    REQUIRE(pread(item->getFd(), read_back.data(), read_back.size(), 0) == static_cast<ssize_t>(content.size()));
+    REQUIRE(read_back == content);
+
+    remove_test_dir();
+}
+
+TEST_CASE("File Cache Pool", "[streaming]")
+{
+    FileCachePool pool(1024 * 1024, 10, 1, "lru", 16384, 64 * 1024, 512 * 1024);
+    // peekFile only returns entries that do not need revalidation
+    pool.setRevalidateInterval(std::chrono::seconds(60));
+    create_test_dir();
+
+    auto small = create_test_file(1024, "small");
+    pool.getFile(small);
+    REQUIRE(pool.getCurrentItemCount() == 1);
+
+    // files above the threshold or above the whole budget are streamed and bypass the cache
+    for (off_t size : {512 * 1024, 1024 * 1024 + 1, 1024 * 1024 * 64})
+    {
+        auto large = create_test_file(size, "large");
+        auto item = pool.getFile(large);
+        REQUIRE(item);
+        REQUIRE(item->isStreaming());
+        REQUIRE(item->getFd() >= 0);
+        REQUIRE(!item->isInMemory());
+        REQUIRE(item->getStat()->st_size == size);
+        REQUIRE(!pool.peekFile(large));
+        // nothing else was evicted
+        REQUIRE(pool.getCurrentItemCount() == 1);
+        REQUIRE(pool.peekFile(small));
+        REQUIRE(pool.peekFile(small)->isInMemory());
+    }
+
+    // sizes above 2GB are carried in 64 bits
+    auto huge = create_test_file(5LL * 1024 * 1024 * 1024, "huge");
+    auto item = pool.getFile(huge);
+    REQUIRE(item->isStreaming());
+    REQUIRE(item->getStat()->st_size == 5LL * 1024 * 1024 * 1024);
+
+    remove_test_dir();
+}
+
+TEST_CASE("File Cache Pool", "[validators]")
+{
+    FileCachePool pool(1024 * 1024, 10);
+    create_test_dir();
+
+    auto path = create_test_file(1024, "test1");
+    auto item = pool.getFile(path);
+    REQUIRE(item->getETag() == HTTPHeaderParser::makeETag(*item->getStat()));
+    REQUIRE(item->getLastModified() == HTTPHeaderParser::formatDate(item->getStat()->st_mtim.tv_sec));
+    // the tag changes with the file
+    create_test_file(2048, "test1");
+    auto modified = pool.getFile(path);
+    REQUIRE(modified->getETag() != item->getETag());
+
+    // content hashes agree for identical files regardless of mtime
+    pool.setHashETag(true);
+    auto copy = create_test_file(2048, "test2");
+    auto hashed = pool.getFile(copy);
+    REQUIRE(hashed->getETag() != HTTPHeaderParser::makeETag(*hashed->getStat()));
+    FileCachePool other(1024 * 1024, 10);
+    other.setHashETag(true);
+    REQUIRE(other.getFile(path)->getETag() == hashed->getETag());
+    create_test_file(4096, "test2");
+    REQUIRE(pool.getFile(copy)->getETag() != hashed->getETag());
+
+    remove_test_dir();
+}
+
+TEST_CASE("File Cache Pool", "[precompressed]")
+{
+    FileCachePool pool(1024 * 1024, 10);
+    create_test_dir();
+
+    auto path = create_test_file(4096, "test1");
+    create_test_file(1024, "test1.gz");
+    // disabled by default
+    REQUIRE(!pool.getFile(path)->hasVariants());
+
+    pool.setPrecompressed(true);
+    pool.invalidate(path);
+    auto item = pool.getFile(path);
+    REQUIRE(item->hasVariants());
+    REQUIRE(item->getVariant(HTTPHeaderParser::Encoding::GZIP)->getStat()->st_size == 1024);
+    REQUIRE(!item->getVariant(HTTPHeaderParser::Encoding::BR));
+    // the variant is accounted together with the file
+    REQUIRE(pool.getCurrentSize() == item->getResidentSize());
+    REQUIRE(item->getResidentSize() > item->getVariant(HTTPHeaderParser::Encoding::GZIP)->getResidentSize());
+
+    // changing the variant drops the cached file
+    create_test_file(2048, "test1.br");
+    pool.invalidate("test_dir/test1.br");
+    item = pool.getFile(path);
+    REQUIRE(item->getVariant(HTTPHeaderParser::Encoding::BR)->getStat()->st_size == 2048);
+
+    // variants older than the file are ignored
+    struct timespec times[2] = {{0, UTIME_OMIT}, {1000000000, 0}};
+    REQUIRE(utimensat(AT_FDCWD, "test_dir/test1.gz", times, 0) == 0);
+    pool.invalidate(path);
+    item = pool.getFile(path);
+    REQUIRE(!item->getVariant(HTTPHeaderParser::Encoding::GZIP));
+    REQUIRE(item->getVariant(HTTPHeaderParser::Encoding::BR));
+
+    // revalidation stats the variants too, without a watcher calling invalidate
+    create_test_file(1024, "test1.gz");
+    item = pool.getFile(path);
+    REQUIRE(item->getVariant(HTTPHeaderParser::Encoding::GZIP)->getStat()->st_size == 1024);
+    create_test_file(512, "test1.zst");
+    item = pool.getFile(path);
+    REQUIRE(item->getVariant(HTTPHeaderParser::Encoding::ZSTD)->getStat()->st_size == 512);
+    REQUIRE(remove("test_dir/test1.br") == 0);
+    item = pool.getFile(path);
+    REQUIRE(!item->getVariant(HTTPHeaderParser::Encoding::BR));
+    REQUIRE(pool.getFile(path) == item);
+
+    remove_test_dir();
+}
+
+TEST_CASE("File Cache Pool", "[compression]")
+{
+    FileCachePool pool(1024 * 1024, 10);
+    create_test_dir();
+
+    auto write_text = [](const std::string &path, const std::string &line) {
+        std::ofstream out(path);
+        for (int i = 0; i < 1000; i++)
+        {
+            out << line << i << "\n";
+        }
+    };
+    auto wait_compressed = [&pool](const std::shared_ptr<FileCacheItem> &item) {
+        for (int i = 0; i < 500; i++)
+        {
+            if (auto compressed = pool.getCompressed(item, HTTPHeaderParser::Encoding::GZIP))
+                return compressed;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return std::shared_ptr<FileCacheItem>();
+    };
+    write_text("test_dir/text", "some compressible text ");
+    auto item = pool.getFile("test_dir/text");
+    // disabled by default
+    REQUIRE(!pool.isCompressible(*item));
+    REQUIRE(!pool.getCompressed(item, HTTPHeaderParser::Encoding::GZIP));
+
+    pool.setCompression({HTTPHeaderParser::Encoding::GZIP}, 1024, 1024 * 1024);
+    REQUIRE(pool.isCompressible(*item));
+    REQUIRE(!pool.isCompressible(*pool.getFile(create_test_file(100, "tiny"))));
+    // encodings that were not enabled are never produced
+    REQUIRE(!pool.getCompressed(item, HTTPHeaderParser::Encoding::BR));
+
+    // the identity version is served until the copy is ready
+    auto compressed = wait_compressed(item);
+    REQUIRE(compressed);
+    REQUIRE(compressed->getStat()->st_size * 4 < item->getStat()->st_size);
+    REQUIRE(compressed->getSourceETag() == item->getETag());
+    REQUIRE(compressed->getETag() != item->getETag());
+    REQUIRE(compressed->getLastModified() == item->getLastModified());
+    // the copy is a separate entry charged against the budget
+    REQUIRE(pool.getCurrentItemCount() == 3);
+    REQUIRE(pool.getCurrentSize() == item->getResidentSize() + compressed->getResidentSize() + pool.getFile("test_dir/tiny")->getResidentSize());
+    REQUIRE(pool.getCompressed(item, HTTPHeaderParser::Encoding::GZIP) == compressed);
+
+    // a new version of the file gets a new copy
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    write_text("test_dir/text", "changed text ");
+    pool.invalidate("test_dir/text");
+    auto modified = pool.getFile("test_dir/text");
+    REQUIRE(pool.getCurrentItemCount() == 2);
+    auto recompressed = wait_compressed(modified);
+    REQUIRE(recompressed);
+    REQUIRE(recompressed != compressed);
+    REQUIRE(recompressed->getSourceETag() == modified->getETag());
+
+    // incompressible content is remembered and served as is
+    {
+        std::ofstream out("test_dir/random", std::ios::binary);
+        uint64_t x = 88172645463325252ULL;
+        for (int i = 0; i < 4096; i++)
+        {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            out.write(reinterpret_cast<const char *>(&x), sizeof(x));
+        }
+    }
+    auto random = pool.getFile("test_dir/random");
+    REQUIRE(!pool.getCompressed(random, HTTPHeaderParser::Encoding::GZIP));
+    for (int i = 0; i < 500 && pool.getCurrentItemCount() < 5; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    REQUIRE(pool.getCurrentItemCount() == 5);
+    REQUIRE(!pool.getCompressed(random, HTTPHeaderParser::Encoding::GZIP));
+
+    remove_test_dir();
+}
+
+TEST_CASE("File Cache Pool", "[response headers]")
+{
+    FileCachePool pool(1024 * 1024, 10);
+    create_test_dir();
+
+    auto item = pool.getFile(create_test_file(1024, "index.html"));
+    REQUIRE(item->getContentType() == "text/html");
+    REQUIRE(item->getEncoding() == nullptr);
+    REQUIRE(!item->getVary());
+    REQUIRE(item->getHeaderBlock() == "HTTP/1.1 200 OK\r\nAccept-Ranges: bytes\r\nContent-Length: 1024\r\nContent-Type: text/html\r\nETag: " + item->getETag() + "\r\nLast-Modified: " + item->getLastModified() + "\r\n");
+    REQUIRE(pool.getFile(create_test_file(10, "noextension"))->getContentType() == "application/unknown");
+
+    // siblings keep the type of the file and add their encoding
+    pool.setPrecompressed(true);
+    create_test_file(100, "style.css");
+    create_test_file(10, "style.css.gz");
+    item = pool.getFile("test_dir/style.css");
+    REQUIRE(item->getVary());
+    REQUIRE(item->getHeaderBlock().ends_with("\r\nVary: Accept-Encoding\r\n"));
+    auto variant = item->getVariant(HTTPHeaderParser::Encoding::GZIP);
+    REQUIRE(variant->getContentType() == "text/css");
+    REQUIRE(std::string(variant->getEncoding()) == "gzip");
+    REQUIRE(variant->getHeaderBlock().find("\r\nContent-Length: 10\r\nContent-Type: text/css\r\nContent-Encoding: gzip\r\n") != std::string::npos);
+
+    // extensions match regardless of case, overrides from the configuration win over the built-in table
+    REQUIRE(pool.getFile(create_test_file(10, "LOGO.PNG"))->getContentType() == "image/png");
+    pool.setMimeTypes(MimeTypes(std::vector<std::pair<std::string, std::string>>{{"md", "text/markdown; charset=utf-8"}}));
+    REQUIRE(pool.getFile(create_test_file(10, "README.md"))->getContentType() == "text/markdown; charset=utf-8");
+
+    remove_test_dir();
+}
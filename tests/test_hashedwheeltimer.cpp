@@ -121,4 +121,28 @@ TEST_CASE("Hash Wheel Timer", "[duplicate timer]")
     {
         REQUIRE(flags[i] == true);
     }
-}
\ No newline at end of file
+}
+TEST_CASE("Hash Wheel Timer", "[rearm in callback]")
+{
+    HashedWheelTimer timer(10, std::chrono::milliseconds(100));
+    int count = 0;
+    Timer t;
+    // the callback re-adds its own timer until it has fired 3 times
+    t.callback = [&]()
+    {
+        if (++count < 3)
+        {
+            t.time_point = std::chrono::high_resolution_clock::now() + std::chrono::milliseconds(200);
+            timer.addTimer(&t);
+        }
+    };
+    t.time_point = std::chrono::high_resolution_clock::now() + std::chrono::milliseconds(100);
+    timer.addTimer(&t);
+
+    for (int i = 0; i < 20; i++)
+    {
+        timer.tick();
+    }
+
+    REQUIRE(count == 3);
+}
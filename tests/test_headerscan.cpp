@@ -0,0 +1,87 @@
+#include <catch2/catch_all.hpp>
+#include "headerscan.h"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    std::vector<HeaderScan::Impl> supportedImpls()
+    {
+        std::vector<HeaderScan::Impl> impls;
+        for (auto impl : {HeaderScan::Impl::SCALAR, HeaderScan::Impl::SSE2, HeaderScan::Impl::AVX2})
+        {
+            if (HeaderScan::isSupported(impl))
+                impls.push_back(impl);
+        }
+        return impls;
+    }
+}
+
+TEST_CASE("Header Scan", "[find]")
+{
+    REQUIRE(HeaderScan::isSupported(HeaderScan::Impl::SCALAR));
+    auto impls = supportedImpls();
+
+    std::string line = "Host: www.bilibili.com\r\n";
+    for (auto impl : impls)
+    {
+        REQUIRE(HeaderScan::find(impl, line.data(), line.size(), ':', '\n') == 4);
+        REQUIRE(HeaderScan::find(impl, line.data(), line.size(), '\n', '\n') == line.size() - 1);
+        REQUIRE(HeaderScan::find(impl, line.data(), line.size() - 1, '\n', '\n') == line.size() - 1);
+        REQUIRE(HeaderScan::find(impl, line.data(), 0, ':', '\n') == 0);
+    }
+
+    // 在各种长度和起始偏移下与逐字节的实现比较，覆盖向量的边界和尾部
+    std::mt19937 rng(42);
+    std::string buffer(512, 'a');
+    for (int round = 0; round < 200; round++)
+    {
+        for (auto &c : buffer)
+        {
+            c = "abcdefghij-: \r\n"[rng() % 15];
+        }
+        for (size_t offset = 0; offset < 33; offset++)
+        {
+            size_t len = rng() % (buffer.size() - offset);
+            size_t expected = HeaderScan::find(HeaderScan::Impl::SCALAR, buffer.data() + offset, len, ':', '\n');
+            for (auto impl : impls)
+            {
+                REQUIRE(HeaderScan::find(impl, buffer.data() + offset, len, ':', '\n') == expected);
+            }
+        }
+    }
+
+    // 没有分隔符的长数据
+    std::string plain(300, 'x');
+    for (auto impl : impls)
+    {
+        for (size_t len = 0; len <= plain.size(); len++)
+        {
+            REQUIRE(HeaderScan::find(impl, plain.data(), len, ':', '\n') == len);
+        }
+    }
+}
+
+TEST_CASE("Header Scan", "[dispatch]")
+{
+    auto original = HeaderScan::selected();
+    REQUIRE(HeaderScan::isSupported(original));
+    // 默认选择CPU支持的最快实现
+    REQUIRE(original == supportedImpls().back());
+
+    for (auto impl : supportedImpls())
+    {
+        REQUIRE(HeaderScan::select(impl));
+        REQUIRE(HeaderScan::selected() == impl);
+        REQUIRE(HeaderScan::find("GET / HTTP/1.1\r\n", 16, '\n', '\n') == 15);
+    }
+    for (auto impl : {HeaderScan::Impl::SSE2, HeaderScan::Impl::AVX2})
+    {
+        if (!HeaderScan::isSupported(impl))
+        {
+            REQUIRE(!HeaderScan::select(impl));
+        }
+    }
+    REQUIRE(HeaderScan::select(original));
+}
@@ -1,5 +1,6 @@
 #include <catch2/catch_all.hpp>
 #include "httpheaderparser.h"
+#include "headerscan.h"
 #include <string>
 
 TEST_CASE("HTTP Header Parser", "[basic]")
@@ -60,4 +61,312 @@ TEST_CASE("HTTP Header Parser", "[respond parser]")
     opt["Content-Type"] = "text/html; charset=utf-8";
     auto respond = parser.getRespondHeader("HTTP/1.1", HTTPHeaderParser::StatusCode::OK, opt);
     REQUIRE(*respond == "HTTP/1.1 200 OK\r\nConnection: keep-alive\r\nContent-Type: text/html; charset=utf-8\r\n\r\n");
-}
\ No newline at end of file
+}
+TEST_CASE("HTTP Header Parser", "[reset]")
+{
+    HTTPHeaderParser parser;
+    char buffer[1024];
+    memset(buffer, 0, sizeof(char)*1024);
+    parser.setBuffer(buffer);
+
+    std::string request_header = "GET /index.html HTTP/1.1\r\nRange: bytes=0-1\r\n\r\n";
+    memcpy(buffer, request_header.c_str(), request_header.size());
+    REQUIRE(parser.parseRequest(request_header.size()) == HTTPHeaderParser::Status::DONE);
+    REQUIRE(parser.getRequestHeader()->opt.contains("Range"));
+
+    // 同一个连接上的下一个请求不能继承上一个请求的键值对
+    parser.reset();
+    request_header = "GET /index.html HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    memcpy(buffer, request_header.c_str(), request_header.size());
+    REQUIRE(parser.parseRequest(request_header.size()) == HTTPHeaderParser::Status::DONE);
+    REQUIRE(!parser.getRequestHeader()->opt.contains("Range"));
+}
+
+TEST_CASE("HTTP Header Parser", "[range]")
+{
+    using Ranges = std::vector<std::pair<off_t, off_t>>;
+    auto parse = [](const std::string &value, off_t size) -> std::optional<Ranges> {
+        auto ranges = HTTPHeaderParser::parseRange(value, size);
+        if (!ranges)
+            return std::nullopt;
+        Ranges result;
+        for (auto &range : *ranges)
+            result.emplace_back(range.first, range.last);
+        return result;
+    };
+
+    REQUIRE(parse("bytes=0-499", 1000) == Ranges{{0, 499}});
+    REQUIRE(parse("bytes=500-", 1000) == Ranges{{500, 999}});
+    REQUIRE(parse("bytes=-200", 1000) == Ranges{{800, 999}});
+    REQUIRE(parse("bytes=-2000", 1000) == Ranges{{0, 999}});
+    REQUIRE(parse("bytes=900-5000", 1000) == Ranges{{900, 999}});
+    REQUIRE(parse("bytes=0-0, 2-3,-1", 1000) == Ranges{{0, 0}, {2, 3}, {999, 999}});
+    // 不可满足的区间被跳过，全部不可满足时为416
+    REQUIRE(parse("bytes=1000-", 1000) == Ranges{});
+    REQUIRE(parse("bytes=-0", 1000) == Ranges{});
+    REQUIRE(parse("bytes=0-1,2000-3000", 1000) == Ranges{{0, 1}});
+    REQUIRE(parse("bytes=0-", 0) == Ranges{});
+    // 无效的Range被忽略，返回整个文件
+    REQUIRE(!parse("items=0-1", 1000));
+    REQUIRE(!parse("bytes=", 1000));
+    REQUIRE(!parse("bytes=abc", 1000));
+    REQUIRE(!parse("bytes=5-1", 1000));
+    REQUIRE(!parse("bytes=-", 1000));
+    REQUIRE(!parse("bytes=1-2-3", 1000));
+    REQUIRE(!parse("bytes=99999999999999999999-", 1000));
+    // 超过2GB的偏移量
+    REQUIRE(parse("bytes=4294967296-", 5368709120LL) == Ranges{{4294967296LL, 5368709119LL}});
+    // 区间过多，或者重叠的区间总长度超过文件本身
+    std::string many = "bytes=0-0";
+    for (int i = 1; i <= HTTPHeaderParser::MAX_RANGE_COUNT; i++)
+        many += "," + std::to_string(i * 2) + "-" + std::to_string(i * 2);
+    REQUIRE(!parse(many, 1000));
+    REQUIRE(!parse("bytes=0-,0-", 1000));
+}
+
+TEST_CASE("HTTP Header Parser", "[validators]")
+{
+    REQUIRE(HTTPHeaderParser::formatDate(784111777) == "Sun, 06 Nov 1994 08:49:37 GMT");
+    struct stat fstat = {};
+    fstat.st_mtim.tv_sec = 0x5f000000;
+    fstat.st_mtim.tv_nsec = 0x10;
+    fstat.st_size = 0x400;
+    auto etag = HTTPHeaderParser::makeETag(fstat);
+    REQUIRE(etag == "\"5f000000-10-400\"");
+    auto date = HTTPHeaderParser::formatDate(fstat.st_mtim.tv_sec);
+    REQUIRE(HTTPHeaderParser::ifRangeMatches(etag, etag, date));
+    REQUIRE(HTTPHeaderParser::ifRangeMatches(date, etag, date));
+    REQUIRE(!HTTPHeaderParser::ifRangeMatches("W/" + etag, etag, date));
+    REQUIRE(!HTTPHeaderParser::ifRangeMatches("\"other\"", etag, date));
+    REQUIRE(!HTTPHeaderParser::ifRangeMatches("Sun, 06 Nov 1994 08:49:37 GMT", etag, date));
+}
+
+TEST_CASE("HTTP Header Parser", "[partial respond]")
+{
+    HTTPHeaderParser parser;
+    HTTPHeaderParser::KVMap opt;
+    opt["Content-Range"] = "bytes 0-9/100";
+    opt["Content-Length"] = "10";
+    auto respond = parser.getRespondHeader("HTTP/1.1", HTTPHeaderParser::StatusCode::PARTIAL_CONTENT, opt);
+    REQUIRE(*respond == "HTTP/1.1 206 Partial Content\r\nContent-Length: 10\r\nContent-Range: bytes 0-9/100\r\n\r\n");
+
+    opt.clear();
+    opt["Content-Range"] = "bytes */100";
+    respond = parser.getRespondHeader("HTTP/1.1", HTTPHeaderParser::StatusCode::RANGE_NOT_SATISFIABLE, opt);
+    REQUIRE(*respond == "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */100\r\nContent-Length: 25\r\n\r\n416 Range Not Satisfiable");
+}
+
+TEST_CASE("HTTP Header Parser", "[conditional]")
+{
+    // 三种日期格式
+    REQUIRE(HTTPHeaderParser::parseDate("Sun, 06 Nov 1994 08:49:37 GMT") == 784111777);
+    REQUIRE(HTTPHeaderParser::parseDate("Sunday, 06-Nov-94 08:49:37 GMT") == 784111777);
+    REQUIRE(HTTPHeaderParser::parseDate("Sun Nov  6 08:49:37 1994") == 784111777);
+    REQUIRE(!HTTPHeaderParser::parseDate("yesterday"));
+    REQUIRE(!HTTPHeaderParser::parseDate("Sun, 06 Nov 1994 08:49:37 GMT trailing"));
+    REQUIRE(HTTPHeaderParser::parseDate(HTTPHeaderParser::formatDate(1700000000)) == 1700000000);
+    auto &date = HTTPHeaderParser::currentDateHeader();
+    REQUIRE(date.starts_with("Date: "));
+    REQUIRE(date.ends_with(" GMT\r\n"));
+    REQUIRE(HTTPHeaderParser::parseDate(date.substr(6, date.size() - 8)));
+
+    std::string etag = "\"5f000000-10-400\"";
+    REQUIRE(HTTPHeaderParser::ifNoneMatchMatches(etag, etag));
+    REQUIRE(HTTPHeaderParser::ifNoneMatchMatches("*", etag));
+    // If-None-Match使用弱比较
+    REQUIRE(HTTPHeaderParser::ifNoneMatchMatches("W/" + etag, etag));
+    REQUIRE(HTTPHeaderParser::ifNoneMatchMatches("\"a\", " + etag + " ,\"b\"", etag));
+    REQUIRE(!HTTPHeaderParser::ifNoneMatchMatches("\"a\", \"b\"", etag));
+    REQUIRE(!HTTPHeaderParser::ifNoneMatchMatches("", etag));
+
+    // 304没有响应体
+    HTTPHeaderParser parser;
+    HTTPHeaderParser::KVMap opt;
+    opt["ETag"] = etag;
+    auto respond = parser.getRespondHeader("HTTP/1.1", HTTPHeaderParser::StatusCode::NOT_MODIFIED, opt);
+    REQUIRE(*respond == "HTTP/1.1 304 Not Modified\r\nETag: " + etag + "\r\n\r\n");
+}
+
+TEST_CASE("HTTP Header Parser", "[accept encoding]")
+{
+    using Encoding = HTTPHeaderParser::Encoding;
+    auto accept = [](std::string_view value) {
+        auto encodings = HTTPHeaderParser::parseAcceptEncoding(value);
+        return std::vector<Encoding>(encodings.begin(), encodings.end());
+    };
+    REQUIRE(HTTPHeaderParser::parseAcceptEncoding("").empty());
+    REQUIRE(HTTPHeaderParser::parseAcceptEncoding("identity").empty());
+    // q值相同时按照服务器的偏好排列
+    REQUIRE(accept("gzip, deflate, br, zstd") == std::vector<Encoding>{Encoding::BR, Encoding::ZSTD, Encoding::GZIP});
+    REQUIRE(accept("gzip;q=1.0, br;q=0.5") == std::vector<Encoding>{Encoding::GZIP, Encoding::BR});
+    // 大小写不敏感，x-gzip等同于gzip
+    REQUIRE(accept("X-GZIP") == std::vector<Encoding>{Encoding::GZIP});
+    // q=0表示不接受，*匹配没有列出的编码
+    REQUIRE(accept("br;q=0, *") == std::vector<Encoding>{Encoding::ZSTD, Encoding::GZIP});
+    REQUIRE(HTTPHeaderParser::parseAcceptEncoding("*;q=0, gzip").size() == 1);
+    REQUIRE(HTTPHeaderParser::parseAcceptEncoding(" gzip ; q=0 ").empty());
+
+    REQUIRE(std::string(HTTPHeaderParser::encoding2str(Encoding::ZSTD)) == "zstd");
+    REQUIRE(std::string(HTTPHeaderParser::encodingExtension(Encoding::ZSTD)) == ".zst");
+}
+
+TEST_CASE("HTTP Header Parser", "[view]")
+{
+    HTTPHeaderParser parser(HTTPHeaderParser::Mode::VIEW);
+    char buffer[2048];
+    memset(buffer, 0, sizeof(buffer));
+    parser.setBuffer(buffer);
+
+    std::string request_header = "GET /static/app.js HTTP/1.1\r\nhost:www.bilibili.com\r\nCONNECTION: keep-alive\r\nAccept-Encoding:  gzip, br \r\nX-Custom: a: b\r\n\r\n";
+    memcpy(buffer, request_header.c_str(), request_header.size());
+    REQUIRE(parser.parseRequest(request_header.size()) == HTTPHeaderParser::Status::DONE);
+    auto view = parser.getRequestView();
+    REQUIRE(view->method == HTTPHeaderParser::Method::GET);
+    REQUIRE(view->path == "static/app.js");
+    REQUIRE(view->version == "HTTP/1.1");
+    REQUIRE(view->count == 4);
+    // 已知字段按照下标访问，名称大小写不敏感，值去掉了两端的空白
+    REQUIRE(view->get(HTTPHeaderParser::Field::HOST) == "www.bilibili.com");
+    REQUIRE(view->get(HTTPHeaderParser::Field::CONNECTION) == "keep-alive");
+    REQUIRE(view->get(HTTPHeaderParser::Field::ACCEPT_ENCODING) == "gzip, br");
+    REQUIRE(view->get(HTTPHeaderParser::Field::RANGE).empty());
+    // 其他字段按照名称查找，值中的冒号保留
+    REQUIRE(view->find("x-custom") == "a: b");
+    REQUIRE(view->find("Host") == "www.bilibili.com");
+    REQUIRE(view->find("X-Missing").empty());
+    // 视图指向缓冲区，MAP模式之外不会复制
+    REQUIRE(view->path.data() == buffer + 5);
+    REQUIRE(parser.getRequestHeader()->opt.empty());
+
+    // 重置之后不保留上一个请求的字段
+    parser.reset();
+    request_header = "GET / HTTP/1.1\r\n\r\n";
+    memcpy(buffer, request_header.c_str(), request_header.size());
+    REQUIRE(parser.parseRequest(request_header.size()) == HTTPHeaderParser::Status::DONE);
+    REQUIRE(view->path.empty());
+    REQUIRE(view->count == 0);
+    REQUIRE(view->get(HTTPHeaderParser::Field::HOST).empty());
+
+    // 请求头超过数组的容量时仍然能够解析，超出的部分不记录在数组中，但已知字段照常填写
+    parser.reset();
+    request_header = "GET / HTTP/1.1\r\n";
+    for (size_t i = 0; i < HTTPHeaderParser::MAX_HEADER_COUNT + 8; i++)
+    {
+        request_header += "X-" + std::to_string(i) + ": v\r\n";
+    }
+    request_header += "Host: www.bilibili.com\r\nRange: bytes=0-1\r\n\r\n";
+    REQUIRE(request_header.size() < sizeof(buffer));
+    memcpy(buffer, request_header.c_str(), request_header.size());
+    REQUIRE(parser.parseRequest(request_header.size()) == HTTPHeaderParser::Status::DONE);
+    REQUIRE(view->count == HTTPHeaderParser::MAX_HEADER_COUNT);
+    REQUIRE(view->get(HTTPHeaderParser::Field::HOST) == "www.bilibili.com");
+    REQUIRE(view->get(HTTPHeaderParser::Field::RANGE) == "bytes=0-1");
+    REQUIRE(view->find("X-0") == "v");
+
+    // MAP模式下全部请求头都在映射中
+    HTTPHeaderParser map_parser;
+    map_parser.setBuffer(buffer);
+    memcpy(buffer, request_header.c_str(), request_header.size());
+    REQUIRE(map_parser.parseRequest(request_header.size()) == HTTPHeaderParser::Status::DONE);
+    REQUIRE(map_parser.getRequestHeader()->opt.size() == HTTPHeaderParser::MAX_HEADER_COUNT + 10);
+    REQUIRE(map_parser.getRequestHeader()->opt["X-39"] == "v");
+    REQUIRE(map_parser.getRequestHeader()->opt["Host"] == "www.bilibili.com");
+
+    REQUIRE(HTTPHeaderParser::str2field("if-none-match") == HTTPHeaderParser::Field::IF_NONE_MATCH);
+    REQUIRE(HTTPHeaderParser::str2field("If-None-Matc") == HTTPHeaderParser::Field::UNKNOWN);
+}
+
+TEST_CASE("HTTP Header Parser", "[split]")
+{
+    std::string request_header = "GET /static/app.js HTTP/1.1\r\nHost: www.bilibili.com\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\nAccept: */*\r\nReferer: http://www.bilibili.com/index.html\r\nIf-Modified-Since: Wed, 21 Oct 2015 07:28:00 GMT\r\n\r\n";
+    char buffer[1024];
+    auto original = HeaderScan::selected();
+    for (auto impl : {HeaderScan::Impl::SCALAR, HeaderScan::Impl::SSE2, HeaderScan::Impl::AVX2})
+    {
+        if (!HeaderScan::select(impl))
+            continue;
+        // 请求在任意位置被分成两次读取，结果与一次读取完整时相同
+        for (size_t split = 1; split < request_header.size(); split++)
+        {
+            HTTPHeaderParser parser(HTTPHeaderParser::Mode::VIEW);
+            memset(buffer, 0, sizeof(buffer));
+            parser.setBuffer(buffer);
+            memcpy(buffer, request_header.c_str(), split);
+            REQUIRE(parser.parseRequest(split) == HTTPHeaderParser::Status::WORKING);
+            memcpy(buffer + split, request_header.c_str() + split, request_header.size() - split);
+            REQUIRE(parser.parseRequest(request_header.size()) == HTTPHeaderParser::Status::DONE);
+            auto view = parser.getRequestView();
+            REQUIRE(view->path == "static/app.js");
+            REQUIRE(view->count == 5);
+            REQUIRE(view->get(HTTPHeaderParser::Field::HOST) == "www.bilibili.com");
+            REQUIRE(view->find("Referer") == "http://www.bilibili.com/index.html");
+            REQUIRE(view->get(HTTPHeaderParser::Field::IF_MODIFIED_SINCE) == "Wed, 21 Oct 2015 07:28:00 GMT");
+        }
+        // 没有\r的换行是错误
+        HTTPHeaderParser parser;
+        memset(buffer, 0, sizeof(buffer));
+        parser.setBuffer(buffer);
+        std::string bad = "GET / HTTP/1.1\r\nHost: a\n\r\n";
+        memcpy(buffer, bad.c_str(), bad.size());
+        REQUIRE(parser.parseRequest(bad.size()) == HTTPHeaderParser::Status::ERROR);
+    }
+    HeaderScan::select(original);
+}
+
+TEST_CASE("HTTP Header Parser", "[pipeline]")
+{
+    HTTPHeaderParser parser(HTTPHeaderParser::Mode::VIEW);
+    char buffer[1024];
+    memset(buffer, 0, sizeof(buffer));
+    std::string first = "GET /a.html HTTP/1.1\r\nHost: a\r\n\r\n";
+    std::string second = "GET /b.css HTTP/1.1\r\nHost: b\r\nRange: bytes=0-1\r\n\r\n";
+    std::string pipelined = first + second + "GET /c.js HTTP/1.1\r\nHo";
+    memcpy(buffer, pipelined.c_str(), pipelined.size());
+
+    // 同一个缓冲区中的请求依次解析，每个请求从上一个请求的结尾开始
+    parser.setBuffer(buffer);
+    REQUIRE(parser.parseRequest(pipelined.size()) == HTTPHeaderParser::Status::DONE);
+    REQUIRE(parser.getRequestView()->path == "a.html");
+    REQUIRE(parser.getRequestSize() == static_cast<int>(first.size()));
+    size_t parsed = parser.getRequestSize();
+    parser.setBuffer(buffer + parsed);
+    REQUIRE(parser.parseRequest(pipelined.size() - parsed) == HTTPHeaderParser::Status::DONE);
+    REQUIRE(parser.getRequestView()->path == "b.css");
+    REQUIRE(parser.getRequestView()->get(HTTPHeaderParser::Field::RANGE) == "bytes=0-1");
+    REQUIRE(parser.getRequestSize() == static_cast<int>(second.size()));
+    parsed += parser.getRequestSize();
+    parser.setBuffer(buffer + parsed);
+    REQUIRE(parser.parseRequest(pipelined.size() - parsed) == HTTPHeaderParser::Status::WORKING);
+
+    // 不完整的请求被移动到缓冲区的开头之后继续解析，已经解析的部分不会重新解析
+    size_t remain = pipelined.size() - parsed;
+    memmove(buffer, buffer + parsed, remain);
+    parser.moveBuffer(buffer);
+    std::string rest = "st: c\r\nAccept-Encoding: gzip\r\n\r\n";
+    memcpy(buffer + remain, rest.c_str(), rest.size());
+    REQUIRE(parser.parseRequest(remain + rest.size()) == HTTPHeaderParser::Status::DONE);
+    auto view = parser.getRequestView();
+    REQUIRE(view->path == "c.js");
+    REQUIRE(view->path.data() == buffer + 5);
+    REQUIRE(view->version == "HTTP/1.1");
+    REQUIRE(view->get(HTTPHeaderParser::Field::HOST) == "c");
+    REQUIRE(view->get(HTTPHeaderParser::Field::ACCEPT_ENCODING) == "gzip");
+    REQUIRE(parser.getRequestSize() == static_cast<int>(remain + rest.size()));
+}
+
+TEST_CASE("HTTP Header Parser", "[keep alive]")
+{
+    REQUIRE(HTTPHeaderParser::hasToken("keep-alive", "keep-alive"));
+    REQUIRE(HTTPHeaderParser::hasToken("Upgrade, Keep-Alive ", "keep-alive"));
+    REQUIRE(!HTTPHeaderParser::hasToken("keep-alive-ish", "keep-alive"));
+    REQUIRE(!HTTPHeaderParser::hasToken("", "close"));
+
+    // HTTP/1.1默认保持连接，close不区分大小写
+    REQUIRE(HTTPHeaderParser::keepAlive("HTTP/1.1", ""));
+    REQUIRE(HTTPHeaderParser::keepAlive("HTTP/1.1", "Keep-Alive"));
+    REQUIRE(!HTTPHeaderParser::keepAlive("HTTP/1.1", "close"));
+    REQUIRE(!HTTPHeaderParser::keepAlive("HTTP/1.1", "Close"));
+    // HTTP/1.0只在带有keep-alive时保持连接
+    REQUIRE(!HTTPHeaderParser::keepAlive("HTTP/1.0", ""));
+    REQUIRE(HTTPHeaderParser::keepAlive("HTTP/1.0", "Keep-Alive"));
+}
@@ -0,0 +1,71 @@
+#include <catch2/catch_all.hpp>
+#include "mimetypes.h"
+#include "constants.h"
+#include <cctype>
+#include <string>
+
+TEST_CASE("Mime Types", "[builtin]")
+{
+    MimeTypes types;
+    REQUIRE(types.lookup(".html") == "text/html");
+    REQUIRE(types.lookup(".js") == "application/javascript");
+    REQUIRE(types.lookup(".wasm") == "application/wasm");
+    // 后缀名不区分大小写
+    REQUIRE(types.lookup(".JPG") == "image/jpeg");
+    REQUIRE(types.lookup(".Css") == "text/css");
+    // 没有匹配时使用默认类型
+    REQUIRE(types.lookup(".xxx") == MimeTypes::DEFAULT_TYPE);
+    REQUIRE(types.lookup("") == MimeTypes::DEFAULT_TYPE);
+    REQUIRE(types.lookup("html") == MimeTypes::DEFAULT_TYPE);
+    // 原来表中永远不会匹配的".*"键已经删除
+    REQUIRE(MimeTypes::builtin(".*mp3").empty());
+    REQUIRE(MimeTypes::builtin(".mp3") == "audio/mpeg");
+
+    // 内置表中的每一项都能查到，大写也能查到
+    for (auto &[extension, type] : mimeLookUpTable)
+    {
+        REQUIRE(MimeTypes::builtin(extension) == type);
+        std::string upper(extension);
+        for (auto &c : upper)
+        {
+            c = std::toupper(c);
+        }
+        REQUIRE(MimeTypes::builtin(upper) == type);
+    }
+}
+
+TEST_CASE("Mime Types", "[extension]")
+{
+    REQUIRE(MimeTypes::extension("www/index.html") == ".html");
+    REQUIRE(MimeTypes::extension("archive.tar.gz") == ".gz");
+    REQUIRE(MimeTypes::extension("www/v1.2/README") == "");
+    REQUIRE(MimeTypes::extension("www/.hidden") == "");
+    REQUIRE(MimeTypes::extension("www/.hidden.txt") == ".txt");
+    REQUIRE(MimeTypes::extension("www/file.") == ".");
+    REQUIRE(MimeTypes::extension("..") == "");
+    REQUIRE(MimeTypes::extension("") == "");
+
+    MimeTypes types;
+    REQUIRE(types.lookupPath("www/static/app.JS") == "application/javascript");
+    REQUIRE(types.lookupPath("www/v1.2/README") == MimeTypes::DEFAULT_TYPE);
+}
+
+TEST_CASE("Mime Types", "[overrides]")
+{
+    MimeTypes types({
+        {"md", "text/markdown; charset=utf-8"},
+        {".JS", "text/javascript"},
+        {".usdz", "model/vnd.usdz+zip"},
+        {".js", "text/javascript; charset=utf-8"},
+    });
+    REQUIRE(types.overrideCount() == 3);
+    // 覆盖项可以省略开头的点，不区分大小写，重复的后缀名使用最后一个
+    REQUIRE(types.lookup(".md") == "text/markdown; charset=utf-8");
+    REQUIRE(types.lookup(".Js") == "text/javascript; charset=utf-8");
+    REQUIRE(types.lookup(".USDZ") == "model/vnd.usdz+zip");
+    // 其他后缀名仍然使用内置的类型
+    REQUIRE(types.lookup(".css") == "text/css");
+    REQUIRE(types.lookup(".mdx") == MimeTypes::DEFAULT_TYPE);
+    // 内置表不受影响
+    REQUIRE(MimeTypes::builtin(".js") == "application/javascript");
+}
@@ -0,0 +1,80 @@
+#include <catch2/catch_all.hpp>
+#include "mpmcqueue.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST_CASE("MPMC Queue", "[basic]")
+{
+    MPMCQueue<int> queue(5);
+    int value;
+    REQUIRE(queue.pop(value) == false);
+
+    for (int i = 0; i < 5; i++)
+    {
+        REQUIRE(queue.push(i) == true);
+    }
+    // 队列已满
+    REQUIRE(queue.push(5) == false);
+    REQUIRE(queue.size() == 5);
+
+    // 先进先出，并且可以循环使用槽位
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < 5; i++)
+        {
+            REQUIRE(queue.pop(value) == true);
+            REQUIRE(value == i);
+            REQUIRE(queue.push(i) == true);
+        }
+    }
+    REQUIRE(queue.size() == 5);
+}
+
+TEST_CASE("MPMC Queue", "[concurrent]")
+{
+    MPMCQueue<int> queue(64);
+    const int nr_producer = 4, nr_consumer = 4, nr_item = 20000;
+    std::atomic<long long> sum = 0;
+    std::atomic<int> consumed = 0;
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < nr_producer; p++)
+    {
+        threads.emplace_back([&]()
+        {
+            for (int i = 1; i <= nr_item; i++)
+            {
+                while (!queue.push(i))
+                    std::this_thread::yield();
+            }
+        });
+    }
+    for (int c = 0; c < nr_consumer; c++)
+    {
+        threads.emplace_back([&]()
+        {
+            int value;
+            while (consumed.load() < nr_producer * nr_item)
+            {
+                if (queue.pop(value))
+                {
+                    sum += value;
+                    consumed++;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+
+    // 每个元素恰好被取出一次
+    REQUIRE(consumed.load() == nr_producer * nr_item);
+    REQUIRE(sum.load() == 1LL * nr_producer * nr_item * (nr_item + 1) / 2);
+}
@@ -0,0 +1,141 @@
+#include <catch2/catch_all.hpp>
+#include "slabarena.h"
+#include <atomic>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+
+TEST_CASE("Slab Arena", "[size class]")
+{
+    SlabArena arena(16384);
+    REQUIRE(arena.maxBlock() == 16384);
+    REQUIRE(arena.blockSize(0) == 0);
+    REQUIRE(arena.blockSize(1) == 64);
+    REQUIRE(arena.blockSize(64) == 64);
+    REQUIRE(arena.blockSize(65) == 80);
+    REQUIRE(arena.blockSize(100) == 112);
+    REQUIRE(arena.blockSize(768) == 768);
+    REQUIRE(arena.blockSize(1025) == 1280);
+    REQUIRE(arena.blockSize(16384) == 16384);
+    REQUIRE(arena.blockSize(16385) == 0);
+    // 块内的浪费不超过25%
+    for (size_t size = 64; size <= 16384; size++)
+    {
+        REQUIRE(arena.blockSize(size) >= size);
+        REQUIRE(arena.blockSize(size) * 4 <= size * 5);
+    }
+    REQUIRE(!arena.allocate(0));
+    REQUIRE(!arena.allocate(16385));
+}
+
+TEST_CASE("Slab Arena", "[allocate]")
+{
+    SlabArena arena(4096, 64 * 1024);
+    // 块紧密排列，互不重叠
+    std::vector<char *> blocks;
+    for (int i = 0; i < 100; i++)
+    {
+        auto block = static_cast<char *>(arena.allocate(1000));
+        REQUIRE(block);
+        memset(block, i, 1000);
+        blocks.push_back(block);
+    }
+    REQUIRE(blocks[1] - blocks[0] == 1024);
+    for (int i = 0; i < 100; i++)
+    {
+        REQUIRE(blocks[i][0] == static_cast<char>(i));
+        REQUIRE(blocks[i][999] == static_cast<char>(i));
+    }
+    // 每个slab可以容纳64个1024字节的块
+    REQUIRE(arena.getReservedSize() == 2 * 64 * 1024);
+
+    // 释放的块优先被复用，不需要申请新的slab；每个slab保留一个块，使slab不会被归还
+    for (int i = 1; i < 100; i++)
+    {
+        if (i != 64)
+            arena.deallocate(blocks[i], 1000);
+    }
+    REQUIRE(arena.getReservedSize() == 2 * 64 * 1024);
+    std::set<char *> reused = {blocks[0], blocks[64]};
+    for (int i = 0; i < 98; i++)
+    {
+        reused.insert(static_cast<char *>(arena.allocate(1000)));
+    }
+    REQUIRE(reused == std::set<char *>(blocks.begin(), blocks.end()));
+    REQUIRE(arena.getReservedSize() == 2 * 64 * 1024);
+
+    // 块全部被释放的slab归还系统
+    for (auto block : reused)
+    {
+        arena.deallocate(block, 1000);
+    }
+    REQUIRE(arena.getReservedSize() == 0);
+}
+
+TEST_CASE("Slab Arena", "[release]")
+{
+    SlabArena arena(4096, 64 * 1024);
+    // 反复分配和释放之后保留的内存不会增长，只取决于仍在使用的块
+    std::vector<char *> live;
+    for (int round = 0; round < 10; round++)
+    {
+        std::vector<char *> blocks;
+        for (int i = 0; i < 640; i++)
+        {
+            blocks.push_back(static_cast<char *>(arena.allocate(1000)));
+        }
+        REQUIRE(arena.getReservedSize() <= (live.size() + 640 + 63) / 64 * 64 * 1024 + 64 * 1024);
+        // 留下第一个块，其余全部释放
+        live.push_back(blocks[0]);
+        for (size_t i = 1; i < blocks.size(); i++)
+        {
+            arena.deallocate(blocks[i], 1000);
+        }
+    }
+    REQUIRE(arena.getReservedSize() == 64 * 1024);
+    for (auto block : live)
+    {
+        arena.deallocate(block, 1000);
+    }
+    REQUIRE(arena.getReservedSize() == 0);
+}
+
+TEST_CASE("Slab Arena", "[concurrent]")
+{
+    SlabArena arena(4096);
+    std::atomic<int> corrupted = 0;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&arena, &corrupted, t]() {
+            std::vector<std::pair<char *, size_t>> blocks;
+            for (int i = 0; i < 10000; i++)
+            {
+                size_t size = 1 + (i * 37 + t) % 4096;
+                auto block = static_cast<char *>(arena.allocate(size));
+                memset(block, t, size);
+                blocks.emplace_back(block, size);
+                if (i % 3 == 0)
+                {
+                    arena.deallocate(blocks.back().first, blocks.back().second);
+                    blocks.pop_back();
+                }
+            }
+            for (auto &[block, size] : blocks)
+            {
+                // 其他线程没有写入自己的块
+                if (block[0] != t || block[size - 1] != t)
+                {
+                    corrupted++;
+                }
+                arena.deallocate(block, size);
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    REQUIRE(corrupted == 0);
+}
@@ -2,9 +2,189 @@
 #include "test_utils.h"
 #include "staticserver.h"
 #include <filesystem>
+#include <map>
+#include <optional>
+
+#include <arpa/inet.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
 
 namespace fs = std::filesystem;
 
+namespace
+{
+    const int TEST_PORT = 28080;
+
+    struct Response
+    {
+        int status;
+        std::map<std::string, std::string> headers;
+        std::string body;
+    };
+
+    std::string readFile(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), {});
+    }
+
+    void writeFile(const std::string &path, const std::string &content)
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << content;
+    }
+
+    int connectServer()
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(TEST_PORT);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+        timeval timeout = {5, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        return fd;
+    }
+
+    // 在system_test目录中生成根目录和配置文件，在子进程中启动服务器，reactor为配置中reactor一项的内容
+    // 根目录中有一个小文本文件、一个读入内存的文件和一个超过sendfile_min、使用sendfile发送的文件
+    pid_t startServer(const std::string &reactor)
+    {
+        fs::remove_all("system_test");
+        fs::create_directories("system_test/config");
+        fs::create_directories("system_test/www");
+        writeFile("system_test/www/index.html", "<html><body>static server</body></html>\n");
+        std::string data, large;
+        for (int i = 0; i < 65536; i++)
+        {
+            data += static_cast<char>(i * 7 % 251);
+        }
+        for (int i = 0; i < 2 * 1024 * 1024; i++)
+        {
+            large += static_cast<char>(i * 13 % 253);
+        }
+        writeFile("system_test/www/data.bin", data);
+        writeFile("system_test/www/large.bin", large);
+        writeFile("system_test/config/config.json", "{\"host\": \"127.0.0.1\", \"port\": " + std::to_string(TEST_PORT) +
+                                                        ", \"root\": \"" + fs::absolute("system_test/www").string() +
+                                                        "\", \"loglevel\": \"err\", \"backlog\": 100, \"timeout\": 10, \"reactor\": " + reactor + "}");
+        auto pid = fork();
+        if (pid == 0)
+        {
+            // 子进程运行服务器，退出时不运行父进程中的测试
+            if (chdir("system_test") != 0)
+                _exit(1);
+            StaticServer::s_logger = spdlog::stdout_color_mt("main");
+            StaticServer::create();
+            if (!StaticServer::getInstance()->init())
+                _exit(1);
+            StaticServer::getInstance()->loop();
+            _exit(0);
+        }
+        // 等待服务器开始监听
+        for (int i = 0; i < 50 && pid > 0; i++)
+        {
+            int fd = connectServer();
+            if (fd >= 0)
+            {
+                ::close(fd);
+                break;
+            }
+            usleep(100000);
+        }
+        return pid;
+    }
+
+    void stopServer(pid_t pid)
+    {
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+        fs::remove_all("system_test");
+    }
+
+    // 测试结束或者断言失败时停止服务器，避免占用端口影响后面的测试
+    struct ServerGuard
+    {
+        pid_t pid;
+        ~ServerGuard()
+        {
+            if (pid > 0)
+                stopServer(pid);
+        }
+    };
+
+    // 从连接中依次读取完整的响应，连接在响应完整之前被关闭或者超时时返回std::nullopt
+    class ResponseReader
+    {
+    public:
+        explicit ResponseReader(int fd) : m_fd(fd) {}
+
+        std::optional<Response> next()
+        {
+            size_t end;
+            while ((end = m_buffer.find("\r\n\r\n")) == std::string::npos)
+            {
+                if (!fill())
+                    return std::nullopt;
+            }
+            Response response;
+            std::string head = m_buffer.substr(0, end + 2);
+            m_buffer.erase(0, end + 4);
+            response.status = std::stoi(head.substr(head.find(' ') + 1, 3));
+            for (size_t pos = head.find("\r\n") + 2; pos < head.size();)
+            {
+                auto line_end = head.find("\r\n", pos);
+                auto line = head.substr(pos, line_end - pos);
+                auto colon = line.find(':');
+                response.headers[line.substr(0, colon)] = line.substr(colon + 2);
+                pos = line_end + 2;
+            }
+            size_t length = response.headers.contains("Content-Length") ? std::stoul(response.headers["Content-Length"]) : 0;
+            if (response.status == 304)
+                length = 0;
+            while (m_buffer.size() < length)
+            {
+                if (!fill())
+                    return std::nullopt;
+            }
+            response.body = m_buffer.substr(0, length);
+            m_buffer.erase(0, length);
+            return response;
+        }
+
+        // 对方关闭了连接，并且没有多余的数据
+        bool closed()
+        {
+            return m_buffer.empty() && !fill();
+        }
+
+    private:
+        int m_fd;
+        std::string m_buffer;
+
+        bool fill()
+        {
+            char buf[65536];
+            auto n = recv(m_fd, buf, sizeof(buf), 0);
+            if (n <= 0)
+                return false;
+            m_buffer.append(buf, n);
+            return true;
+        }
+    };
+
+    std::string get(const std::string &path, const std::string &headers = "")
+    {
+        return "GET /" + path + " HTTP/1.1\r\nHost: 127.0.0.1\r\n" + headers + "\r\n";
+    }
+}
+
 TEST_CASE("Static Server", "[system test]")
 {
     auto pid = fork();
@@ -37,4 +217,193 @@ TEST_CASE("Static Server", "[system test]")
 
         REQUIRE(kill(pid, SIGTERM) == 0);
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Static Server", "[pipeline]")
+{
+    ServerGuard server{startServer("{\"mode\": \"pool\", \"inline\": true}")};
+    REQUIRE(server.pid > 0);
+    auto index = readFile("system_test/www/index.html");
+    auto data = readFile("system_test/www/data.bin");
+    auto large = readFile("system_test/www/large.bin");
+
+    {
+        // 不带Connection的HTTP/1.1请求默认保持连接，流水线中的全部请求按照顺序得到响应
+        // 请求的总长度超过接收缓冲区，并且在请求的中间分成两次发送，不完整的请求需要被移动到缓冲区的开头
+        std::string requests;
+        std::vector<std::pair<int, std::string>> expected;
+        for (int i = 0; i < 30; i++)
+        {
+            switch (i % 5)
+            {
+            case 0:
+                requests += get("index.html", "X-Padding: " + std::string(i * 20, 'p') + "\r\n");
+                expected.push_back({200, index});
+                break;
+            case 1:
+                requests += get("data.bin");
+                expected.push_back({200, data});
+                break;
+            case 2:
+                requests += get("large.bin", "Range: bytes=100-199\r\n");
+                expected.push_back({206, large.substr(100, 100)});
+                break;
+            case 3:
+                requests += get("missing.html");
+                expected.push_back({404, "404 Not Found"});
+                break;
+            default:
+                requests += get("large.bin");
+                expected.push_back({200, large});
+                break;
+            }
+        }
+        REQUIRE(requests.size() > READ_BUFFER_SIZE);
+        int fd = connectServer();
+        REQUIRE(fd >= 0);
+        size_t split = requests.size() / 2 + 7;
+        REQUIRE(send(fd, requests.data(), split, MSG_NOSIGNAL) == static_cast<ssize_t>(split));
+        usleep(50000);
+        REQUIRE(send(fd, requests.data() + split, requests.size() - split, MSG_NOSIGNAL) == static_cast<ssize_t>(requests.size() - split));
+        ResponseReader reader(fd);
+        for (size_t i = 0; i < expected.size(); i++)
+        {
+            INFO("Response " << i);
+            auto response = reader.next();
+            REQUIRE(response);
+            REQUIRE(response->status == expected[i].first);
+            REQUIRE(response->body == expected[i].second);
+            REQUIRE(response->headers["Connection"] == "keep-alive");
+        }
+        // 连接仍然可以使用
+        std::string again = get("index.html");
+        REQUIRE(send(fd, again.data(), again.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(again.size()));
+        auto response = reader.next();
+        REQUIRE(response);
+        REQUIRE(response->body == index);
+        ::close(fd);
+    }
+
+    {
+        // Connection: close（不区分大小写）之后的请求不再处理，发送完响应后关闭连接
+        std::string requests = get("index.html") + get("data.bin", "Connection: Close\r\n") + get("index.html");
+        int fd = connectServer();
+        REQUIRE(fd >= 0);
+        REQUIRE(send(fd, requests.data(), requests.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(requests.size()));
+        ResponseReader reader(fd);
+        auto response = reader.next();
+        REQUIRE(response);
+        REQUIRE(response->body == index);
+        response = reader.next();
+        REQUIRE(response);
+        REQUIRE(response->body == data);
+        REQUIRE(response->headers["Connection"] == "close");
+        REQUIRE(reader.closed());
+        ::close(fd);
+    }
+
+    {
+        // HTTP/1.0默认不保持连接
+        std::string requests = "GET /index.html HTTP/1.0\r\n\r\n" + get("index.html");
+        int fd = connectServer();
+        REQUIRE(fd >= 0);
+        REQUIRE(send(fd, requests.data(), requests.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(requests.size()));
+        ResponseReader reader(fd);
+        auto response = reader.next();
+        REQUIRE(response);
+        REQUIRE(response->headers["Connection"] == "close");
+        REQUIRE(reader.closed());
+        ::close(fd);
+    }
+}
+
+TEST_CASE("Static Server", "[multi reactor]")
+{
+    // 每个事件循环使用SO_REUSEPORT监听同一个端口，由内核把连接分配给它们
+    ServerGuard server{startServer("{\"mode\": \"multi\", \"count\": 4}")};
+    REQUIRE(server.pid > 0);
+    std::map<std::string, std::string> files = {
+        {"index.html", readFile("system_test/www/index.html")},
+        {"data.bin", readFile("system_test/www/data.bin")},
+        {"large.bin", readFile("system_test/www/large.bin")},
+    };
+
+    // 先建立全部连接再发送请求，连接同时存在于多个事件循环中
+    std::vector<int> fds;
+    for (int i = 0; i < 16; i++)
+    {
+        int fd = connectServer();
+        REQUIRE(fd >= 0);
+        fds.push_back(fd);
+    }
+    for (int fd : fds)
+    {
+        ResponseReader reader(fd);
+        for (auto &[name, content] : files)
+        {
+            INFO("Checking file " << name << " on socket " << fd);
+            std::string request = get(name);
+            REQUIRE(send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size()));
+            auto response = reader.next();
+            REQUIRE(response);
+            REQUIRE(response->status == 200);
+            REQUIRE(response->body == content);
+        }
+        ::close(fd);
+    }
+}
+
+TEST_CASE("Static Server", "[inline]")
+{
+    // 缓存命中的请求直接在事件循环中响应，未命中的请求交给线程池加载文件
+    ServerGuard server{startServer("{\"mode\": \"pool\", \"inline\": true}")};
+    REQUIRE(server.pid > 0);
+    std::map<std::string, std::string> files = {
+        {"index.html", readFile("system_test/www/index.html")},
+        {"data.bin", readFile("system_test/www/data.bin")},
+        {"large.bin", readFile("system_test/www/large.bin")},
+    };
+
+    // 第一次请求从磁盘加载文件，之后的请求在新的连接上命中缓存
+    std::map<std::string, std::string> etags;
+    for (int round = 0; round < 3; round++)
+    {
+        int fd = connectServer();
+        REQUIRE(fd >= 0);
+        ResponseReader reader(fd);
+        for (auto &[name, content] : files)
+        {
+            INFO("Checking file " << name << " in round " << round);
+            std::string request = get(name);
+            REQUIRE(send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size()));
+            auto response = reader.next();
+            REQUIRE(response);
+            REQUIRE(response->status == 200);
+            REQUIRE(response->body == content);
+            if (round == 0)
+                etags[name] = response->headers["ETag"];
+            REQUIRE(response->headers["ETag"] == etags[name]);
+        }
+        ::close(fd);
+    }
+
+    // 条件请求和Range请求同样在事件循环中响应，sendfile发送的large.bin交给线程池，响应仍然按照请求的顺序
+    int fd = connectServer();
+    REQUIRE(fd >= 0);
+    ResponseReader reader(fd);
+    std::string requests = get("index.html", "If-None-Match: " + etags["index.html"] + "\r\n") + get("large.bin", "Range: bytes=1000-1999\r\n") +
+                           get("index.html", "Range: bytes=6-11\r\n");
+    REQUIRE(send(fd, requests.data(), requests.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(requests.size()));
+    auto response = reader.next();
+    REQUIRE(response);
+    REQUIRE(response->status == 304);
+    response = reader.next();
+    REQUIRE(response);
+    REQUIRE(response->status == 206);
+    REQUIRE(response->body == files["large.bin"].substr(1000, 1000));
+    response = reader.next();
+    REQUIRE(response);
+    REQUIRE(response->status == 206);
+    REQUIRE(response->body == files["index.html"].substr(6, 6));
+    ::close(fd);
+}
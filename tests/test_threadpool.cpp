@@ -1,5 +1,8 @@
 #include <catch2/catch_all.hpp>
 #include "threadpool.h"
+#include <atomic>
+#include <chrono>
+#include <set>
 
 TEST_CASE("Threadpool", "[basic]")
 {
@@ -25,4 +28,174 @@ TEST_CASE("Threadpool", "[basic]")
         REQUIRE(flags[i] == true);
     }
     
-}
\ No newline at end of file
+}
+
+TEST_CASE("Threadpool", "[task count]")
+{
+    ThreadPool pool;
+    pool.start(1, 3);
+
+    // 用一个任务阻塞唯一的工作线程
+    std::atomic<bool> started = false, release = false;
+    pool.appendTask([&]()
+    {
+        started = true;
+        while (!release)
+            std::this_thread::yield();
+    });
+    while (!started)
+        std::this_thread::yield();
+
+    std::function<void()> cb = []() {};
+    for (int i = 0; i < 3; i++)
+    {
+        REQUIRE(pool.appendTask(cb) == true);
+    }
+    REQUIRE(pool.getTaskCount() == 3);
+    // 任务队列已满
+    REQUIRE(pool.appendTask(cb) == false);
+
+    release = true;
+    pool.wait();
+    REQUIRE(pool.getTaskCount() == 0);
+}
+
+TEST_CASE("Threadpool", "[task record]")
+{
+    ThreadPool pool;
+    pool.start(1, 100);
+
+    // 定长任务记录和通用任务混合提交，单个工作线程按提交顺序执行
+    std::vector<int> order;
+    auto handler = [](void *obj, int arg, uint32_t generation)
+    {
+        static_cast<std::vector<int> *>(obj)->push_back(arg + generation);
+    };
+    for (int i = 0; i < 20; i++)
+    {
+        if (i % 3 == 0)
+        {
+            REQUIRE(pool.appendTask([&order, i]() { order.push_back(i); }) == true);
+        }
+        else
+        {
+            REQUIRE(pool.appendTask(ThreadPool::Task{handler, &order, i - 1, 1}) == true);
+        }
+    }
+    pool.wait();
+    pool.stop();
+
+    REQUIRE(order.size() == 20);
+    for (int i = 0; i < 20; i++)
+    {
+        REQUIRE(order[i] == i);
+    }
+}
+
+TEST_CASE("Threadpool", "[stealing]")
+{
+    constexpr int WORKERS = 4;
+    ThreadPool pool;
+    pool.start(WORKERS, 100, ThreadPool::Scheduler::STEALING);
+
+    // 每个工作线程各被一个任务阻塞，记录它们所在的线程
+    struct Blocker
+    {
+        std::atomic<bool> started = false;
+        std::atomic<bool> release = false;
+        std::thread::id id;
+    };
+    Blocker blockers[WORKERS];
+    auto block = [](void *obj, int, uint32_t)
+    {
+        auto blocker = static_cast<Blocker *>(obj);
+        blocker->id = std::this_thread::get_id();
+        blocker->started = true;
+        while (!blocker->release)
+            std::this_thread::yield();
+    };
+    for (int i = 0; i < WORKERS; i++)
+    {
+        REQUIRE(pool.appendTask(ThreadPool::Task{block, &blockers[i], 0, 0}, i) == true);
+    }
+    for (auto &blocker : blockers)
+    {
+        while (!blocker.started)
+            std::this_thread::yield();
+    }
+    std::set<std::thread::id> threads;
+    for (auto &blocker : blockers)
+    {
+        threads.insert(blocker.id);
+    }
+    REQUIRE(threads.size() == WORKERS);
+
+    // 只放开一个工作线程，其余队列的主人仍然被阻塞，放入这些队列的任务只能被它窃取
+    blockers[0].release = true;
+    std::thread::id ran[WORKERS];
+    std::atomic<int> count = 0;
+    struct Record
+    {
+        std::thread::id *id;
+        std::atomic<int> *count;
+    } records[WORKERS];
+    auto handler = [](void *obj, int, uint32_t)
+    {
+        auto record = static_cast<Record *>(obj);
+        *record->id = std::this_thread::get_id();
+        record->count->fetch_add(1);
+    };
+    for (int i = 0; i < WORKERS; i++)
+    {
+        records[i] = {&ran[i], &count};
+        REQUIRE(pool.appendTask(ThreadPool::Task{handler, &records[i], 0, 0}, i) == true);
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (count.load() < WORKERS && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::yield();
+    REQUIRE(count.load() == WORKERS);
+    for (int i = 0; i < WORKERS; i++)
+    {
+        REQUIRE(ran[i] == blockers[0].id);
+    }
+
+    for (auto &blocker : blockers)
+    {
+        blocker.release = true;
+    }
+    pool.wait();
+}
+
+TEST_CASE("Threadpool", "[stealing task count]")
+{
+    ThreadPool pool;
+    pool.start(2, 4, ThreadPool::Scheduler::STEALING);
+
+    // 阻塞全部两个工作线程
+    std::atomic<int> started = 0;
+    std::atomic<bool> release = false;
+    for (int i = 0; i < 2; i++)
+    {
+        pool.appendTask([&]()
+        {
+            started++;
+            while (!release)
+                std::this_thread::yield();
+        });
+    }
+    while (started.load() < 2)
+        std::this_thread::yield();
+
+    // affinity对应的队列已满时放入其他工作线程的队列，总长度仍然为maxtask
+    ThreadPool::Task task{[](void *, int, uint32_t) {}, nullptr, 0, 0};
+    for (int i = 0; i < 4; i++)
+    {
+        REQUIRE(pool.appendTask(task, 0) == true);
+    }
+    REQUIRE(pool.getTaskCount() == 4);
+    REQUIRE(pool.appendTask(task, 0) == false);
+
+    release = true;
+    pool.wait();
+    REQUIRE(pool.getTaskCount() == 0);
+}
@@ -13,7 +13,7 @@
  * @brief Create a test dir
  * 
  */
-void create_test_dir()
+inline void create_test_dir()
 {
     if (system("mkdir -p test_dir") != 0)
     {
@@ -28,7 +28,7 @@ void create_test_dir()
  * @param name file name
  * @return std::string file path
  */
-std::string create_test_file(off_t size, std::string name)
+inline std::string create_test_file(off_t size, std::string name)
 {
     std::string name_with_dir = "test_dir/" + name;
     // remove file if exist
@@ -52,7 +52,7 @@ std::string create_test_file(off_t size, std::string name)
  * @brief remove all test files and the folder
  * 
  */
-void remove_test_dir()
+inline void remove_test_dir()
 {
     if (system("rm -rf test_dir") != 0)
     {
@@ -68,7 +68,7 @@ void remove_test_dir()
  * @return true 
  * @return false 
  */
-bool compareFiles(const std::string& file1, const std::string& file2) {
+inline bool compareFiles(const std::string& file1, const std::string& file2) {
     std::ifstream f1(file1, std::ios::binary | std::ios::ate);
     std::ifstream f2(file2, std::ios::binary | std::ios::ate);
 
@@ -0,0 +1,144 @@
+// 缓存替换策略模拟器：回放访问序列，输出每种策略的命中率
+// 用法：CacheSim [trace|-] [capacity]
+// trace每行一个访问，格式为"key [size]"，size省略时为1；不指定trace时使用内置的合成序列（Zipf分布的热点访问中间夹杂一次全量扫描）
+// capacity为缓存的容量，单位与size相同，默认为1000
+
+#include "cachepolicy.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct Access
+{
+    std::string key;
+    uint64_t size;
+};
+
+struct SimEntry : CacheNode
+{
+    std::string key;
+    uint64_t size;
+};
+
+static std::vector<Access> readTrace(std::istream &in)
+{
+    std::vector<Access> trace;
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream ss(line);
+        Access access{"", 1};
+        if (!(ss >> access.key))
+            continue;
+        ss >> access.size;
+        trace.push_back(std::move(access));
+    }
+    return trace;
+}
+
+static std::vector<Access> syntheticTrace()
+{
+    // 10000个文件的Zipf(0.9)访问，在中间插入对50000个冷文件的一次扫描
+    const int nr_hot = 10000, nr_scan = 50000, nr_access = 400000;
+    std::vector<double> cdf(nr_hot);
+    double sum = 0;
+    for (int i = 0; i < nr_hot; i++)
+    {
+        sum += 1.0 / std::pow(i + 1, 0.9);
+        cdf[i] = sum;
+    }
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> dist(0, sum);
+    std::vector<Access> trace;
+    trace.reserve(nr_access + nr_scan);
+    for (int i = 0; i < nr_access; i++)
+    {
+        if (i == nr_access / 2)
+        {
+            for (int j = 0; j < nr_scan; j++)
+            {
+                trace.push_back({"/scan/" + std::to_string(j), 1});
+            }
+        }
+        auto rank = std::lower_bound(cdf.begin(), cdf.end(), dist(rng)) - cdf.begin();
+        trace.push_back({"/hot/" + std::to_string(rank), 1});
+    }
+    return trace;
+}
+
+static double simulate(const std::string &name, const std::vector<Access> &trace, uint64_t capacity)
+{
+    auto policy = CachePolicy::create(name, capacity);
+    std::unordered_map<std::string, SimEntry> cache;
+    uint64_t used = 0, hits = 0;
+    for (auto &access : trace)
+    {
+        uint64_t hash = std::hash<std::string>{}(access.key);
+        auto it = cache.find(access.key);
+        if (it != cache.end())
+        {
+            hits++;
+            policy->onHit(&it->second);
+            continue;
+        }
+        policy->onMiss(hash);
+        if (access.size > capacity)
+            continue;
+        auto &entry = cache[access.key];
+        entry.key = access.key;
+        entry.size = access.size;
+        entry.hash = hash;
+        policy->onInsert(&entry);
+        used += access.size;
+        // 与FileCachePool相同，淘汰到容量以内，或者策略拒绝接纳新的缓存项
+        while (used > capacity)
+        {
+            auto victim = static_cast<SimEntry *>(policy->victim());
+            bool rejected = victim == &entry;
+            used -= victim->size;
+            policy->onRemove(victim);
+            cache.erase(cache.find(victim->key));
+            if (rejected)
+                break;
+        }
+    }
+    return trace.empty() ? 0 : static_cast<double>(hits) / trace.size();
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<Access> trace;
+    if (argc > 1 && std::string(argv[1]) == "-")
+    {
+        trace = readTrace(std::cin);
+    }
+    else if (argc > 1)
+    {
+        std::ifstream in(argv[1]);
+        if (!in)
+        {
+            std::cerr << "fail to open trace " << argv[1] << std::endl;
+            return 1;
+        }
+        trace = readTrace(in);
+    }
+    else
+    {
+        trace = syntheticTrace();
+    }
+    uint64_t capacity = argc > 2 ? std::stoull(argv[2]) : 1000;
+
+    std::cout << "accesses: " << trace.size() << ", capacity: " << capacity << std::endl;
+    for (auto name : {"lru", "tinylfu", "s3fifo"})
+    {
+        std::cout << name << "\thit ratio: " << simulate(name, trace, capacity) << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+// 请求头解析的基准测试：对一个典型的浏览器请求重复解析，输出每种查找实现下每个请求的耗时
+// 用法：ParserBench [iterations]
+// iterations为每种实现解析的次数，默认为1000000
+
+#include "headerscan.h"
+#include "httpheaderparser.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Chrome访问静态资源时发送的请求头
+static const std::string REQUEST =
+    "GET /static/js/app.8f3a2c1d.js HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Not_A Brand\";v=\"8\", \"Chromium\";v=\"120\", \"Google Chrome\";v=\"120\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+    "sec-ch-ua-platform: \"Windows\"\r\n"
+    "Accept: */*\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Dest: script\r\n"
+    "Referer: https://www.example.com/index.html\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+    "Cookie: _ga=GA1.1.1234567890.1700000000; session=6f1c2e9a8b7d4c3f; theme=dark\r\n"
+    "If-None-Match: \"65a1b2c3-1f2e3\"\r\n"
+    "If-Modified-Since: Wed, 21 Oct 2015 07:28:00 GMT\r\n"
+    "\r\n";
+
+static const char *implName(HeaderScan::Impl impl)
+{
+    switch (impl)
+    {
+    case HeaderScan::Impl::AVX2:
+        return "avx2";
+    case HeaderScan::Impl::SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
+
+// 只查找分隔符，与解析器相同地交替查找冒号和换行
+static double benchScan(HeaderScan::Impl impl, size_t iterations)
+{
+    size_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        size_t pos = 0;
+        bool colon_found = false;
+        while (pos < REQUEST.size())
+        {
+            pos += HeaderScan::find(impl, REQUEST.data() + pos, REQUEST.size() - pos, colon_found ? '\n' : ':', '\n');
+            if (pos < REQUEST.size())
+                colon_found = REQUEST[pos] == ':';
+            checksum += pos++;
+        }
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    if (checksum == 0)
+        std::cerr << "unexpected checksum" << std::endl;
+    return elapsed / iterations;
+}
+
+// 完整解析，解析器会把行尾改为\0，所以每次都从原始请求复制
+static double benchParse(HeaderScan::Impl impl, HTTPHeaderParser::Mode mode, size_t iterations)
+{
+    HeaderScan::select(impl);
+    std::vector<char> buffer(REQUEST.size() + 1);
+    HTTPHeaderParser parser(mode);
+    parser.setBuffer(buffer.data());
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+    {
+        memcpy(buffer.data(), REQUEST.data(), REQUEST.size());
+        parser.reset();
+        if (parser.parseRequest(REQUEST.size()) != HTTPHeaderParser::Status::DONE)
+        {
+            std::cerr << "fail to parse request" << std::endl;
+            return 0;
+        }
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t iterations = argc > 1 ? std::stoull(argv[1]) : 1000000;
+    auto original = HeaderScan::selected();
+
+    std::cout << "request: " << REQUEST.size() << " bytes, iterations: " << iterations << ", default: " << implName(original) << std::endl;
+    for (auto impl : {HeaderScan::Impl::SCALAR, HeaderScan::Impl::SSE2, HeaderScan::Impl::AVX2})
+    {
+        if (!HeaderScan::isSupported(impl))
+            continue;
+        std::cout << implName(impl)
+                  << "\tscan: " << benchScan(impl, iterations) << " ns"
+                  << "\tview: " << benchParse(impl, HTTPHeaderParser::Mode::VIEW, iterations) << " ns"
+                  << "\tmap: " << benchParse(impl, HTTPHeaderParser::Mode::MAP, iterations / 10) << " ns" << std::endl;
+    }
+    HeaderScan::select(original);
+    return 0;
+}